@@ -27,6 +27,7 @@ public class DungeonGeneratorPlugin : ModuleRules
 			new string[]
 			{
 				"Core",
+				"ProceduralMeshComponent",
 				//"DungeonGeneratorPlugin"
 				// ... add other public dependencies that you statically link with here ...
 			}
@@ -0,0 +1,201 @@
+// Copyright (c) 2022 Orfeas Eleftheriou
+
+#include "CorridorRouter.h"
+#include "Algo/Reverse.h"
+
+FCorridorRouter::FCorridorRouter()
+{
+	RowsNum = 0;
+	ColumnsNum = 0;
+	OpenNodesNum = 0;
+	SearchStamp = 0;
+	LastExpandedTilesNum = 0;
+}
+
+void FCorridorRouter::Init(int32 Rows, int32 Columns)
+{
+	if (Rows == RowsNum && Columns == ColumnsNum)
+	{
+		return;
+	}
+
+	RowsNum = Rows;
+	ColumnsNum = Columns;
+
+	const int32 TilesNum = Rows * Columns;
+	ClosedSet.Init(Rows, Columns);
+	CostSoFar.SetNumUninitialized(TilesNum);
+	CameFrom.SetNumUninitialized(TilesNum);
+	VisitStamp.Empty(TilesNum);
+	VisitStamp.AddZeroed(TilesNum);
+	SearchStamp = 0;
+	OpenNodesNum = 0;
+}
+
+SIZE_T FCorridorRouter::GetAllocatedSize() const
+{
+	return OpenList.GetAllocatedSize() + ClosedSet.GetAllocatedSize() + CostSoFar.GetAllocatedSize() + CameFrom.GetAllocatedSize() + VisitStamp.GetAllocatedSize();
+}
+
+void FCorridorRouter::PushOpenNode(const FOpenNode& Node)
+{
+	if (OpenNodesNum == OpenList.Num())
+	{
+		OpenList.AddUninitialized(FMath::Max(OpenList.Num(), 64));
+	}
+
+	//Sift up
+	int32 Index = OpenNodesNum++;
+	while (Index > 0)
+	{
+		const int32 Parent = (Index - 1) / 2;
+		if (!(Node < OpenList[Parent]))
+		{
+			break;
+		}
+		OpenList[Index] = OpenList[Parent];
+		Index = Parent;
+	}
+	OpenList[Index] = Node;
+}
+
+FCorridorRouter::FOpenNode FCorridorRouter::PopOpenNode()
+{
+	const FOpenNode Top = OpenList[0];
+	const FOpenNode Last = OpenList[--OpenNodesNum];
+
+	//Sift down the last node from the root
+	int32 Index = 0;
+	while (true)
+	{
+		int32 Child = 2 * Index + 1;
+		if (Child >= OpenNodesNum)
+		{
+			break;
+		}
+		if (Child + 1 < OpenNodesNum && OpenList[Child + 1] < OpenList[Child])
+		{
+			Child++;
+		}
+		if (!(OpenList[Child] < Last))
+		{
+			break;
+		}
+		OpenList[Index] = OpenList[Child];
+		Index = Child;
+	}
+	if (OpenNodesNum > 0)
+	{
+		OpenList[Index] = Last;
+	}
+	return Top;
+}
+
+bool FCorridorRouter::FindPath(int32 StartIndex, int32 GoalIndex, const TArray<uint8>& TileCosts, int32 HeuristicCost, TArray<int32>& OutPath)
+{
+	OutPath.Reset();
+	LastExpandedTilesNum = 0;
+
+	const int32 TilesNum = RowsNum * ColumnsNum;
+	if (TileCosts.Num() != TilesNum || StartIndex < 0 || StartIndex >= TilesNum || GoalIndex < 0 || GoalIndex >= TilesNum)
+	{
+		return false;
+	}
+
+	//Start a new search. The stamp wraps around once every 4 billion searches so clear the stamps in that case
+	if (++SearchStamp == 0)
+	{
+		FMemory::Memzero(VisitStamp.GetData(), VisitStamp.Num() * sizeof(uint32));
+		SearchStamp = 1;
+	}
+	ClosedSet.Reset();
+	OpenNodesNum = 0;
+
+	const int32 GoalRow = GoalIndex / ColumnsNum;
+	const int32 GoalColumn = GoalIndex % ColumnsNum;
+
+	auto EstimateRemainingCost = [&](int32 Row, int32 Column)
+	{
+		return (FMath::Abs(Row - GoalRow) + FMath::Abs(Column - GoalColumn)) * HeuristicCost;
+	};
+
+	VisitStamp[StartIndex] = SearchStamp;
+	CostSoFar[StartIndex] = 0;
+	CameFrom[StartIndex] = INDEX_NONE;
+
+	FOpenNode StartNode;
+	StartNode.RemainingCost = EstimateRemainingCost(StartIndex / ColumnsNum, StartIndex % ColumnsNum);
+	StartNode.TotalCost = StartNode.RemainingCost;
+	StartNode.TileIndex = StartIndex;
+	PushOpenNode(StartNode);
+
+	//up, right, left, down
+	static const int32 RowOffsets[4] = { -1, 0, 0, 1 };
+	static const int32 ColumnOffsets[4] = { 0, 1, -1, 0 };
+
+	bool bFoundPath = false;
+	while (OpenNodesNum > 0)
+	{
+		const FOpenNode Current = PopOpenNode();
+		const int32 Row = Current.TileIndex / ColumnsNum;
+		const int32 Column = Current.TileIndex % ColumnsNum;
+
+		//The same tile may be pushed multiple times with decreasing costs. Only expand it once
+		if (ClosedSet.Get(Row, Column))
+		{
+			continue;
+		}
+		ClosedSet.Set(Row, Column);
+		LastExpandedTilesNum++;
+
+		if (Current.TileIndex == GoalIndex)
+		{
+			bFoundPath = true;
+			break;
+		}
+
+		const int32 CurrentCost = CostSoFar[Current.TileIndex];
+		for (int32 i = 0; i < 4; i++)
+		{
+			const int32 NearbyRow = Row + RowOffsets[i];
+			const int32 NearbyColumn = Column + ColumnOffsets[i];
+			if (!ClosedSet.IsValidIndex(NearbyRow, NearbyColumn) || ClosedSet.Get(NearbyRow, NearbyColumn))
+			{
+				continue;
+			}
+
+			const int32 NearbyIndex = NearbyRow * ColumnsNum + NearbyColumn;
+			const uint8 EnterCost = TileCosts[NearbyIndex];
+			if (EnterCost == 0)
+			{
+				continue;
+			}
+
+			const int32 NewCost = CurrentCost + EnterCost;
+			if (VisitStamp[NearbyIndex] != SearchStamp || NewCost < CostSoFar[NearbyIndex])
+			{
+				VisitStamp[NearbyIndex] = SearchStamp;
+				CostSoFar[NearbyIndex] = NewCost;
+				CameFrom[NearbyIndex] = Current.TileIndex;
+
+				FOpenNode NearbyNode;
+				NearbyNode.RemainingCost = EstimateRemainingCost(NearbyRow, NearbyColumn);
+				NearbyNode.TotalCost = NewCost + NearbyNode.RemainingCost;
+				NearbyNode.TileIndex = NearbyIndex;
+				PushOpenNode(NearbyNode);
+			}
+		}
+	}
+
+	if (!bFoundPath)
+	{
+		return false;
+	}
+
+	for (int32 TileIndex = GoalIndex; TileIndex != INDEX_NONE; TileIndex = CameFrom[TileIndex])
+	{
+		OutPath.Add(TileIndex);
+	}
+	Algo::Reverse(OutPath);
+	return true;
+}
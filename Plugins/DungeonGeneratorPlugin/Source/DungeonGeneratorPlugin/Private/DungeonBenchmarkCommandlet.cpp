@@ -0,0 +1,337 @@
+// Copyright (c) 2022 Orfeas Eleftheriou
+
+#include "DungeonBenchmarkCommandlet.h"
+#include "TileMatrix.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/PlatformMemory.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/DateTime.h"
+
+DEFINE_LOG_CATEGORY(DungeonBenchmarkLog);
+
+namespace DungeonBenchmark
+{
+	enum EStage
+	{
+		InitTileMap,
+		PlaceRooms,
+		ConnectGeneratedRooms,
+		ProjectGeneric,
+		ProjectRooms,
+		StagesNum
+	};
+
+	static const TCHAR* StageNames[StagesNum] =
+	{
+		TEXT("InitTileMap"),
+		TEXT("PlaceRooms"),
+		TEXT("ConnectGeneratedRooms"),
+		TEXT("ProjectGeneric"),
+		TEXT("ProjectRooms")
+	};
+
+	template<typename T>
+	static void ParseList(const TMap<FString, FString>& ParamVals, const TCHAR* Key, const TCHAR* Default, TArray<T>& OutValues)
+	{
+		const FString* Value = ParamVals.Find(Key);
+		TArray<FString> Entries;
+		(Value ? *Value : FString(Default)).ParseIntoArray(Entries, TEXT(","), true);
+
+		for (int32 i = 0; i < Entries.Num(); i++)
+		{
+			T Entry;
+			LexFromString(Entry, *Entries[i].TrimStartAndEnd());
+			OutValues.Add(Entry);
+		}
+	}
+
+	static int32 ParseInt(const TMap<FString, FString>& ParamVals, const TCHAR* Key, int32 Default)
+	{
+		const FString* Value = ParamVals.Find(Key);
+		return Value ? FCString::Atoi(**Value) : Default;
+	}
+
+	static uint64 GetUsedPhysical()
+	{
+		return FPlatformMemory::GetStats().UsedPhysical;
+	}
+
+	static uint64 GetProjectedSize(const TArray<FTileMatrix::FFloorSpawnPoint>& FloorLocations, const TArray<FTileMatrix::FWallSpawnPoint>& WallLocations)
+	{
+		return FloorLocations.GetAllocatedSize() + WallLocations.GetAllocatedSize();
+	}
+}
+
+UDungeonBenchmarkCommandlet::UDungeonBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+	ShowErrorCount = true;
+}
+
+int32 UDungeonBenchmarkCommandlet::Main(const FString& Params)
+{
+	TArray<FString> Tokens;
+	TArray<FString> Switches;
+	TMap<FString, FString> ParamVals;
+	ParseCommandLine(*Params, Tokens, Switches, ParamVals);
+
+	//ParseCommandLine keeps the case of the keys
+	TMap<FString, FString> LowerParamVals;
+	for (const TPair<FString, FString>& ParamVal : ParamVals)
+	{
+		LowerParamVals.Add(ParamVal.Key.ToLower(), ParamVal.Value);
+	}
+
+	TArray<int32> Sizes;
+	DungeonBenchmark::ParseList(LowerParamVals, TEXT("sizes"), TEXT("50,100,250,500,1000,2000,4000"), Sizes);
+
+	TArray<FString> RoomSizeEntries;
+	DungeonBenchmark::ParseList(LowerParamVals, TEXT("roomsizes"), TEXT("3-5,5-7,8-12"), RoomSizeEntries);
+
+	TArray<float> FillRatios;
+	DungeonBenchmark::ParseList(LowerParamVals, TEXT("fillratios"), TEXT("0.1,0.3"), FillRatios);
+
+	TArray<int32> RoomCounts;
+	DungeonBenchmark::ParseList(LowerParamVals, TEXT("rooms"), TEXT(""), RoomCounts);
+
+	const int32 Iterations = FMath::Max(1, DungeonBenchmark::ParseInt(LowerParamVals, TEXT("iterations"), 3));
+	const int32 Seed = DungeonBenchmark::ParseInt(LowerParamVals, TEXT("seed"), 1337);
+	const float TileSize = LowerParamVals.Contains(TEXT("tilesize")) ? FCString::Atof(*LowerParamVals[TEXT("tilesize")]) : 100.f;
+	const bool bMerge = Switches.ContainsByPredicate([](const FString& Switch) { return Switch.Equals(TEXT("Merge"), ESearchCase::IgnoreCase); });
+	const FString Label = LowerParamVals.FindRef(TEXT("label"));
+	const FString Format = LowerParamVals.Contains(TEXT("format")) ? LowerParamVals[TEXT("format")].ToLower() : FString(TEXT("both"));
+
+	FString OutputPath = LowerParamVals.FindRef(TEXT("output"));
+	if (OutputPath.IsEmpty())
+	{
+		OutputPath = FPaths::ProjectSavedDir() / TEXT("DungeonBenchmark") / FString::Printf(TEXT("Benchmark-%s"), *FDateTime::Now().ToString());
+	}
+
+	//Build the sweep
+	TArray<FBenchmarkConfig> Configs;
+	for (int32 i = 0; i < Sizes.Num(); i++)
+	{
+		for (int32 j = 0; j < RoomSizeEntries.Num(); j++)
+		{
+			FString MinRoomSizeString;
+			FString MaxRoomSizeString;
+			if (!RoomSizeEntries[j].Split(TEXT("-"), &MinRoomSizeString, &MaxRoomSizeString))
+			{
+				MinRoomSizeString = MaxRoomSizeString = RoomSizeEntries[j];
+			}
+
+			FBenchmarkConfig Config;
+			Config.Size = Sizes[i];
+			Config.MinRoomSize = FCString::Atoi(*MinRoomSizeString);
+			Config.MaxRoomSize = FCString::Atoi(*MaxRoomSizeString);
+			if (Config.Size <= 0 || Config.MinRoomSize <= 0 || Config.MaxRoomSize < Config.MinRoomSize)
+			{
+				UE_LOG(DungeonBenchmarkLog, Warning, TEXT("Skipping invalid configuration: size %d, room size %s"), Config.Size, *RoomSizeEntries[j]);
+				continue;
+			}
+
+			//The fill ratio only picks the room count. The fill that was actually placed is reported with the results
+			const float AverageRoomSize = (Config.MinRoomSize + Config.MaxRoomSize) * 0.5f;
+			const float AverageRoomArea = AverageRoomSize * AverageRoomSize;
+
+			for (int32 k = 0; k < FillRatios.Num(); k++)
+			{
+				Config.FillRatio = FillRatios[k];
+				const int32 RoomsNum = FMath::FloorToInt(Config.FillRatio * Config.Size * Config.Size / AverageRoomArea);
+				Config.RoomsNum = FMath::Clamp(RoomsNum, 1, FTileMatrix::MaxRoomsNum);
+				Configs.Add(Config);
+			}
+
+			for (int32 k = 0; k < RoomCounts.Num(); k++)
+			{
+				Config.FillRatio = -1.f;
+				Config.RoomsNum = FMath::Clamp(RoomCounts[k], 1, FTileMatrix::MaxRoomsNum);
+				Configs.Add(Config);
+			}
+		}
+	}
+
+	if (Configs.Num() == 0)
+	{
+		UE_LOG(DungeonBenchmarkLog, Error, TEXT("Nothing to benchmark. Verify the Sizes, RoomSizes, FillRatios and Rooms parameters"));
+		return 1;
+	}
+
+	//Placement logs a line per run which would otherwise show up in the timings
+	const ELogVerbosity::Type TileMatrixLogVerbosity = TileMatrixLog.GetVerbosity();
+	TileMatrixLog.SetVerbosity(ELogVerbosity::Warning);
+
+	TArray<FConfigResult> Results;
+	Results.Reserve(Configs.Num());
+	for (int32 i = 0; i < Configs.Num(); i++)
+	{
+		const FBenchmarkConfig& Config = Configs[i];
+		UE_LOG(DungeonBenchmarkLog, Display, TEXT("[%d/%d] Size %d, room size %d-%d, %d rooms"), i + 1, Configs.Num(), Config.Size, Config.MinRoomSize, Config.MaxRoomSize, Config.RoomsNum);
+
+		FConfigResult& Result = Results.Add_GetRef(RunConfig(Config, Iterations, Seed, TileSize, bMerge));
+		for (int32 j = 0; j < Result.Stages.Num(); j++)
+		{
+			const FStageResult& Stage = Result.Stages[j];
+			UE_LOG(DungeonBenchmarkLog, Display, TEXT("    %-24s min %10.3f ms, mean %10.3f ms, %llu bytes"), *Stage.Stage, Stage.MinMs, Stage.TotalMs / Iterations, Stage.AllocatedBytes);
+		}
+	}
+
+	TileMatrixLog.SetVerbosity(TileMatrixLogVerbosity);
+
+	bool bSaved = true;
+	if (Format == TEXT("csv") || Format == TEXT("both"))
+	{
+		bSaved &= FFileHelper::SaveStringToFile(ToCsv(Results, Label, Seed), *(OutputPath + TEXT(".csv")));
+	}
+	if (Format == TEXT("json") || Format == TEXT("both"))
+	{
+		bSaved &= FFileHelper::SaveStringToFile(ToJson(Results, Label, Seed), *(OutputPath + TEXT(".json")));
+	}
+
+	if (!bSaved)
+	{
+		UE_LOG(DungeonBenchmarkLog, Error, TEXT("Cannot write the results to %s"), *OutputPath);
+		return 1;
+	}
+
+	UE_LOG(DungeonBenchmarkLog, Display, TEXT("Results written to %s"), *FPaths::ConvertRelativePathToFull(OutputPath));
+	return 0;
+}
+
+UDungeonBenchmarkCommandlet::FConfigResult UDungeonBenchmarkCommandlet::RunConfig(const FBenchmarkConfig& Config, int32 Iterations, int32 Seed, float TileSize, bool bMerge)
+{
+	using namespace DungeonBenchmark;
+
+	FConfigResult Result;
+	Result.Config = Config;
+	Result.Iterations = Iterations;
+	Result.Stages.SetNum(StagesNum);
+	for (int32 i = 0; i < StagesNum; i++)
+	{
+		Result.Stages[i].Stage = StageNames[i];
+	}
+
+	for (int32 Iteration = 0; Iteration < Iterations; Iteration++)
+	{
+		FTileMatrix TileMatrix;
+		TArray<FTileMatrix::FFloorSpawnPoint> FloorLocations;
+		TArray<FTileMatrix::FWallSpawnPoint> WallLocations;
+		TArray<FTileMatrix::FRoom> Rooms;
+		TArray<FTileMatrix::FFloorSpawnPoint> CorridorFloorTiles;
+		TArray<FTileMatrix::FWallSpawnPoint> CorridorWalls;
+
+		double StageStart = 0.0;
+		uint64 StageUsedPhysical = 0;
+
+		auto BeginStage = [&StageStart, &StageUsedPhysical]()
+		{
+			StageUsedPhysical = GetUsedPhysical();
+			StageStart = FPlatformTime::Seconds();
+		};
+
+		auto EndStage = [&](EStage Stage, uint64 AllocatedBytes)
+		{
+			const double Ms = (FPlatformTime::Seconds() - StageStart) * 1000.0;
+			FStageResult& StageResult = Result.Stages[Stage];
+			StageResult.MinMs = FMath::Min(StageResult.MinMs, Ms);
+			StageResult.MaxMs = FMath::Max(StageResult.MaxMs, Ms);
+			StageResult.TotalMs += Ms;
+
+			//Every iteration produces the same layout so the sizes only need to be recorded once
+			StageResult.AllocatedBytes = AllocatedBytes;
+			Result.PeakAllocatedBytes = FMath::Max(Result.PeakAllocatedBytes, AllocatedBytes);
+			StageResult.UsedPhysicalDeltaBytes = FMath::Max(StageResult.UsedPhysicalDeltaBytes, static_cast<int64>(GetUsedPhysical()) - static_cast<int64>(StageUsedPhysical));
+		};
+
+		BeginStage();
+		TileMatrix.InitTileMap(Config.Size, Config.Size);
+		EndStage(InitTileMap, TileMatrix.GetAllocatedSize());
+
+		TileMatrix.RandomStream.Initialize(Seed);
+		TileMatrix.bMergeWalls = bMerge;
+		TileMatrix.bMergeFloors = bMerge;
+		TileMatrix.SetRoomSize(Config.MinRoomSize, Config.MaxRoomSize);
+
+		BeginStage();
+		TileMatrix.PlaceRooms(Config.RoomsNum);
+		EndStage(PlaceRooms, TileMatrix.GetAllocatedSize());
+
+		BeginStage();
+		TileMatrix.ConnectGeneratedRooms();
+		EndStage(ConnectGeneratedRooms, TileMatrix.GetAllocatedSize());
+
+		BeginStage();
+		TileMatrix.ProjectTileMapLocationsToWorld(TileSize, FloorLocations, WallLocations);
+		EndStage(ProjectGeneric, TileMatrix.GetAllocatedSize() + GetProjectedSize(FloorLocations, WallLocations));
+
+		//The projected locations of the previous stage aren't needed anymore
+		FloorLocations.Empty();
+		WallLocations.Empty();
+
+		BeginStage();
+		TileMatrix.ProjectTileMapLocationsToWorld(TileSize, Rooms, CorridorFloorTiles, CorridorWalls);
+		uint64 RoomsBytes = Rooms.GetAllocatedSize();
+		for (int32 i = 0; i < Rooms.Num(); i++)
+		{
+			RoomsBytes += GetProjectedSize(Rooms[i].FloorSpawnPoints, Rooms[i].WallSpawnPoints);
+		}
+		EndStage(ProjectRooms, TileMatrix.GetAllocatedSize() + RoomsBytes + GetProjectedSize(CorridorFloorTiles, CorridorWalls));
+
+		Result.RoomsPlaced = TileMatrix.GetRoomsNum();
+
+		int64 RoomTilesNum = 0;
+		for (int32 i = 0; i < TileMatrix.GetRoomsNum(); i++)
+		{
+			RoomTilesNum += TileMatrix.GetRoomInfo(i).TilesNum;
+		}
+		Result.RoomFill = static_cast<float>(static_cast<double>(RoomTilesNum) / (static_cast<double>(Config.Size) * Config.Size));
+	}
+
+	Result.ProcessPeakUsedPhysicalBytes = FPlatformMemory::GetStats().PeakUsedPhysical;
+	return Result;
+}
+
+FString UDungeonBenchmarkCommandlet::ToCsv(const TArray<FConfigResult>& Results, const FString& Label, int32 Seed)
+{
+	FString Csv = TEXT("Label,Seed,Size,MinRoomSize,MaxRoomSize,FillRatio,RoomsRequested,RoomsPlaced,RoomFill,Stage,MinMs,MeanMs,MaxMs,AllocatedBytes,UsedPhysicalDeltaBytes,PeakAllocatedBytes,ProcessPeakUsedPhysicalBytes\n");
+	for (int32 i = 0; i < Results.Num(); i++)
+	{
+		const FConfigResult& Result = Results[i];
+		const FBenchmarkConfig& Config = Result.Config;
+		for (int32 j = 0; j < Result.Stages.Num(); j++)
+		{
+			const FStageResult& Stage = Result.Stages[j];
+			Csv += FString::Printf(TEXT("%s,%d,%d,%d,%d,%.3f,%d,%d,%.4f,%s,%.3f,%.3f,%.3f,%llu,%lld,%llu,%llu\n"),
+				*Label, Seed, Config.Size, Config.MinRoomSize, Config.MaxRoomSize, Config.FillRatio, Config.RoomsNum, Result.RoomsPlaced, Result.RoomFill,
+				*Stage.Stage, Stage.MinMs, Stage.TotalMs / Result.Iterations, Stage.MaxMs, Stage.AllocatedBytes, Stage.UsedPhysicalDeltaBytes, Result.PeakAllocatedBytes, Result.ProcessPeakUsedPhysicalBytes);
+		}
+	}
+	return Csv;
+}
+
+FString UDungeonBenchmarkCommandlet::ToJson(const TArray<FConfigResult>& Results, const FString& Label, int32 Seed)
+{
+	FString Json = FString::Printf(TEXT("{\n\t\"label\": \"%s\",\n\t\"seed\": %d,\n\t\"results\": [\n"), *Label.ReplaceCharWithEscapedChar(), Seed);
+	for (int32 i = 0; i < Results.Num(); i++)
+	{
+		const FConfigResult& Result = Results[i];
+		const FBenchmarkConfig& Config = Result.Config;
+		Json += FString::Printf(TEXT("\t\t{\n\t\t\t\"size\": %d,\n\t\t\t\"minRoomSize\": %d,\n\t\t\t\"maxRoomSize\": %d,\n\t\t\t\"fillRatio\": %.3f,\n\t\t\t\"roomsRequested\": %d,\n\t\t\t\"roomsPlaced\": %d,\n\t\t\t\"roomFill\": %.4f,\n\t\t\t\"peakAllocatedBytes\": %llu,\n\t\t\t\"processPeakUsedPhysicalBytes\": %llu,\n\t\t\t\"stages\": [\n"),
+			Config.Size, Config.MinRoomSize, Config.MaxRoomSize, Config.FillRatio, Config.RoomsNum, Result.RoomsPlaced, Result.RoomFill, Result.PeakAllocatedBytes, Result.ProcessPeakUsedPhysicalBytes);
+
+		for (int32 j = 0; j < Result.Stages.Num(); j++)
+		{
+			const FStageResult& Stage = Result.Stages[j];
+			Json += FString::Printf(TEXT("\t\t\t\t{ \"stage\": \"%s\", \"minMs\": %.3f, \"meanMs\": %.3f, \"maxMs\": %.3f, \"allocatedBytes\": %llu, \"usedPhysicalDeltaBytes\": %lld }%s\n"),
+				*Stage.Stage, Stage.MinMs, Stage.TotalMs / Result.Iterations, Stage.MaxMs, Stage.AllocatedBytes, Stage.UsedPhysicalDeltaBytes, j + 1 < Result.Stages.Num() ? TEXT(",") : TEXT(""));
+		}
+
+		Json += FString::Printf(TEXT("\t\t\t]\n\t\t}%s\n"), i + 1 < Results.Num() ? TEXT(",") : TEXT(""));
+	}
+	Json += TEXT("\t]\n}\n");
+	return Json;
+}
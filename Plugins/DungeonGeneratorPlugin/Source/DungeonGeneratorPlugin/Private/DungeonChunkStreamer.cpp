@@ -0,0 +1,290 @@
+// Copyright (c) 2022 Orfeas Eleftheriou
+
+#include "DungeonChunkStreamer.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
+#include "ProceduralMeshComponent.h"
+#include "DungeonMeshMerger.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "Kismet/GameplayStatics.h"
+#include "TimerManager.h"
+#include "Async/Async.h"
+
+ADungeonChunkStreamer::ADungeonChunkStreamer()
+{
+	//Every machine streams its own chunks around its own tracked actor
+	bReplicates = false;
+}
+
+void ADungeonChunkStreamer::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (bStreamOnBeginPlay)
+	{
+		StartStreaming();
+	}
+}
+
+void ADungeonChunkStreamer::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	StopStreaming();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+int32 ADungeonChunkStreamer::GetChunkSeed(int32 InWorldSeed, const FIntPoint& ChunkCoordinate)
+{
+	return static_cast<int32>(HashCombine(GetTypeHash(InWorldSeed), GetTypeHash(ChunkCoordinate)));
+}
+
+int32 ADungeonChunkStreamer::GetEdgePortal(const FIntPoint& ChunkCoordinate, int32 Axis, int32 EdgeLength) const
+{
+	//Keep the portals away from the corners so they never touch a third chunk
+	const uint32 EdgeHash = HashCombine(static_cast<uint32>(GetChunkSeed(WorldSeed, ChunkCoordinate)), GetTypeHash(Axis));
+	return 1 + static_cast<int32>(EdgeHash % static_cast<uint32>(FMath::Max(EdgeLength - 2, 1)));
+}
+
+FVector ADungeonChunkStreamer::GetChunkOrigin(const FIntPoint& ChunkCoordinate) const
+{
+	//Rows extend along X and columns along Y
+	return GetActorLocation() + FVector(ChunkCoordinate.X * TileMapRows * ChunkTileSize, ChunkCoordinate.Y * TileMapColumns * ChunkTileSize, 0.f);
+}
+
+FIntPoint ADungeonChunkStreamer::GetChunkAt(const FVector& WorldLocation) const
+{
+	//Tile locations point at the center of each tile
+	const FVector LocalLocation = WorldLocation - GetActorLocation() + FVector(ChunkTileSize / 2.f, ChunkTileSize / 2.f, 0.f);
+	return FIntPoint(FMath::FloorToInt(LocalLocation.X / (TileMapRows * ChunkTileSize)), FMath::FloorToInt(LocalLocation.Y / (TileMapColumns * ChunkTileSize)));
+}
+
+FVector ADungeonChunkStreamer::GetTrackedLocation() const
+{
+	if (TrackedActor)
+	{
+		return TrackedActor->GetActorLocation();
+	}
+	if (const APawn* PlayerPawn = UGameplayStatics::GetPlayerPawn(this, 0))
+	{
+		return PlayerPawn->GetActorLocation();
+	}
+	return GetActorLocation();
+}
+
+void ADungeonChunkStreamer::StartStreaming()
+{
+	if (!FloorSM || !WallSM)
+	{
+		UE_LOG(DungeonGenerator, Error, TEXT("Cannot stream dungeon chunks. Verify you have assigned a valid FloorSM and WallSM"));
+		return;
+	}
+
+	if (RoomTemplatesDataTable)
+	{
+		UE_LOG(DungeonGenerator, Warning, TEXT("Dungeon chunks are spawned with FloorSM and WallSM. RoomTemplatesDataTable is ignored"));
+	}
+
+	//Portals need at least a tile between them and the corners
+	if (TileMapRows < 3 || TileMapColumns < 3)
+	{
+		UE_LOG(DungeonGenerator, Error, TEXT("Cannot stream dungeon chunks smaller than 3x3 tiles"));
+		return;
+	}
+
+	StopStreaming();
+	ChunkTileSize = FloorTileSize;
+
+	GetWorldTimerManager().SetTimer(ChunkUpdateTimerHandle, this, &ADungeonChunkStreamer::UpdateChunks, ChunkUpdateInterval, true);
+	UpdateChunks();
+}
+
+void ADungeonChunkStreamer::StopStreaming()
+{
+	GetWorldTimerManager().ClearTimer(ChunkUpdateTimerHandle);
+
+	//Drops the chunks that are still generating
+	ChunkRequestId++;
+
+	for (TPair<FIntPoint, FDungeonChunk>& Chunk : Chunks)
+	{
+		DespawnChunk(Chunk.Value);
+	}
+	Chunks.Empty();
+}
+
+int32 ADungeonChunkStreamer::GetSpawnedChunksNum() const
+{
+	int32 SpawnedChunksNum = 0;
+	for (const TPair<FIntPoint, FDungeonChunk>& Chunk : Chunks)
+	{
+		if (!Chunk.Value.bIsGenerating)
+		{
+			SpawnedChunksNum++;
+		}
+	}
+	return SpawnedChunksNum;
+}
+
+void ADungeonChunkStreamer::UpdateChunks()
+{
+	const FIntPoint CenterChunk = GetChunkAt(GetTrackedLocation());
+
+	//Despawn the chunks that are past the margin
+	const int32 DespawnRadius = ChunkStreamingRadius + FMath::Max(ChunkDespawnMargin, 0);
+	for (auto It = Chunks.CreateIterator(); It; ++It)
+	{
+		const FIntPoint Offset = It.Key() - CenterChunk;
+		if (FMath::Max(FMath::Abs(Offset.X), FMath::Abs(Offset.Y)) > DespawnRadius)
+		{
+			DespawnChunk(It.Value());
+			It.RemoveCurrent();
+		}
+	}
+
+	//Request the missing chunks, closest first
+	for (int32 Ring = 0; Ring <= ChunkStreamingRadius; Ring++)
+	{
+		for (int32 X = -Ring; X <= Ring; X++)
+		{
+			for (int32 Y = -Ring; Y <= Ring; Y++)
+			{
+				if (FMath::Max(FMath::Abs(X), FMath::Abs(Y)) != Ring)
+				{
+					continue;
+				}
+
+				const FIntPoint ChunkCoordinate = CenterChunk + FIntPoint(X, Y);
+				if (!Chunks.Contains(ChunkCoordinate))
+				{
+					RequestChunk(ChunkCoordinate);
+				}
+			}
+		}
+	}
+}
+
+void ADungeonChunkStreamer::RequestChunk(const FIntPoint& ChunkCoordinate)
+{
+	const uint32 RequestId = ++ChunkRequestId;
+
+	FDungeonChunk& Chunk = Chunks.Add(ChunkCoordinate);
+	Chunk.bIsGenerating = true;
+	Chunk.RequestId = RequestId;
+
+	TSharedRef<FTileMatrix, ESPMode::ThreadSafe> ChunkTileMatrix = MakeShared<FTileMatrix, ESPMode::ThreadSafe>();
+	ConfigureTileMatrix(*ChunkTileMatrix);
+	ChunkTileMatrix->RandomStream.Initialize(GetChunkSeed(WorldSeed, ChunkCoordinate));
+
+	//Portals on the edges shared with the 4 neighbor chunks
+	ChunkTileMatrix->AddBorderPortal(TileMapRows - 1, GetEdgePortal(ChunkCoordinate, 0, TileMapColumns));
+	ChunkTileMatrix->AddBorderPortal(0, GetEdgePortal(ChunkCoordinate - FIntPoint(1, 0), 0, TileMapColumns));
+	ChunkTileMatrix->AddBorderPortal(GetEdgePortal(ChunkCoordinate, 1, TileMapRows), TileMapColumns - 1);
+	ChunkTileMatrix->AddBorderPortal(GetEdgePortal(ChunkCoordinate - FIntPoint(0, 1), 1, TileMapRows), 0);
+
+	TWeakObjectPtr<ADungeonChunkStreamer> WeakThis(this);
+	const int32 RoomsNum = RoomsToGenerate;
+	const float TileSize = ChunkTileSize;
+
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [WeakThis, ChunkCoordinate, RequestId, ChunkTileMatrix, RoomsNum, TileSize]()
+	{
+		ChunkTileMatrix->CreateRooms(RoomsNum);
+		ChunkTileMatrix->ConnectBorderPortals();
+
+		TSharedRef<TArray<FTileMatrix::FFloorSpawnPoint>, ESPMode::ThreadSafe> FloorTileLocations = MakeShared<TArray<FTileMatrix::FFloorSpawnPoint>, ESPMode::ThreadSafe>();
+		TSharedRef<TArray<FTileMatrix::FWallSpawnPoint>, ESPMode::ThreadSafe> WallSpawnPoints = MakeShared<TArray<FTileMatrix::FWallSpawnPoint>, ESPMode::ThreadSafe>();
+		ChunkTileMatrix->ProjectTileMapLocationsToWorld(TileSize, *FloorTileLocations, *WallSpawnPoints);
+
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, ChunkCoordinate, RequestId, FloorTileLocations, WallSpawnPoints]()
+		{
+			ADungeonChunkStreamer* Streamer = WeakThis.Get();
+			if (!Streamer)
+			{
+				return;
+			}
+
+			//The chunk may have been despawned (or requested again) while it was generating
+			FDungeonChunk* Chunk = Streamer->Chunks.Find(ChunkCoordinate);
+			if (!Chunk || Chunk->RequestId != RequestId)
+			{
+				return;
+			}
+
+			Chunk->bIsGenerating = false;
+			Streamer->SpawnChunk(ChunkCoordinate, *FloorTileLocations, *WallSpawnPoints);
+		});
+	});
+}
+
+UHierarchicalInstancedStaticMeshComponent* ADungeonChunkStreamer::CreateChunkComponent(UStaticMesh* SMToSpawn)
+{
+	UHierarchicalInstancedStaticMeshComponent* ChunkComponent = NewObject<UHierarchicalInstancedStaticMeshComponent>(this);
+	ChunkComponent->SetMobility(EComponentMobility::Movable);
+	ChunkComponent->SetStaticMesh(SMToSpawn);
+	ChunkComponent->SetupAttachment(RootComponent);
+	ChunkComponent->RegisterComponent();
+	return ChunkComponent;
+}
+
+void ADungeonChunkStreamer::SpawnChunk(const FIntPoint& ChunkCoordinate, const TArray<FTileMatrix::FFloorSpawnPoint>& FloorTileLocations, const TArray<FTileMatrix::FWallSpawnPoint>& WallSpawnPoints)
+{
+	FDungeonChunk* Chunk = Chunks.Find(ChunkCoordinate);
+	if (!Chunk)
+	{
+		return;
+	}
+
+	const FVector ChunkOrigin = GetChunkOrigin(ChunkCoordinate);
+
+	TArray<FTransform> FloorTransforms;
+	FloorTransforms.Reserve(FloorTileLocations.Num());
+	for (int32 i = 0; i < FloorTileLocations.Num(); i++)
+	{
+		FTransform FloorTransform = CalculateFloorTransform(FloorTileLocations[i], FloorPivotOffset);
+		FloorTransform.AddToTranslation(ChunkOrigin);
+		FloorTransforms.Add(FloorTransform);
+	}
+
+	TArray<FTransform> WallTransforms;
+	WallTransforms.Reserve(WallSpawnPoints.Num());
+	for (int32 i = 0; i < WallSpawnPoints.Num(); i++)
+	{
+		FTransform WallTransform = CalculateWallTransform(bWallFacingX, WallSpawnPoints[i], WallSMPivotOffset);
+		WallTransform.AddToTranslation(ChunkOrigin);
+		WallTransforms.Add(WallTransform);
+	}
+
+	if (SpawnMode == EDungeonSpawnMode::MergedMeshes)
+	{
+		FDungeonMeshMerger Merger;
+		Merger.AddMeshes(0, FloorSM, nullptr, FloorTransforms);
+		Merger.AddMeshes(0, WallSM, nullptr, WallTransforms);
+		Merger.Build();
+
+		if (UProceduralMeshComponent* MergedMeshComponent = CreateMergedMeshComponent(Merger, 0))
+		{
+			Chunk->Components.Add(MergedMeshComponent);
+		}
+		return;
+	}
+
+	UHierarchicalInstancedStaticMeshComponent* FloorComponent = CreateChunkComponent(FloorSM);
+	FloorComponent->AddInstances(FloorTransforms, false, true);
+	Chunk->Components.Add(FloorComponent);
+
+	UHierarchicalInstancedStaticMeshComponent* WallComponent = CreateChunkComponent(WallSM);
+	WallComponent->AddInstances(WallTransforms, false, true);
+	Chunk->Components.Add(WallComponent);
+}
+
+void ADungeonChunkStreamer::DespawnChunk(FDungeonChunk& Chunk)
+{
+	for (int32 i = 0; i < Chunk.Components.Num(); i++)
+	{
+		if (Chunk.Components[i])
+		{
+			Chunk.Components[i]->DestroyComponent();
+		}
+	}
+	Chunk.Components.Empty();
+}
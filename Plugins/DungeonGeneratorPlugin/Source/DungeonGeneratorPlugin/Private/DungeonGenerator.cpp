@@ -3,11 +3,22 @@
 #include "DungeonGenerator.h"
 #include "DrawDebugHelpers.h"
 #include "Components/StaticMeshComponent.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
+#include "Components/SceneComponent.h"
 #include "Engine/StaticMesh.h"
 #include "Engine/StaticMeshActor.h"
 #include "Engine/World.h"
 #include "Materials/MaterialInterface.h"
 #include "Kismet/GameplayStatics.h"
+#include "Async/Async.h"
+#include "Camera/PlayerCameraManager.h"
+#include "GameFramework/Pawn.h"
+#include "Net/UnrealNetwork.h"
+#include "DungeonLayoutCache.h"
+#include "DungeonMeshMerger.h"
+#include "ProceduralMeshComponent.h"
+#include "Engine/AssetManager.h"
+#include "Engine/StreamableManager.h"
 
 DEFINE_LOG_CATEGORY(DungeonGenerator);
 
@@ -47,91 +58,212 @@ FRotator ADungeonGenerator::CalculateWallRotation(bool bWallFacingXProperty, con
 	return WallRotation;
 }
 
-void ADungeonGenerator::SpawnDungeonFromDataTable()
+FTransform ADungeonGenerator::CalculateWallTransform(bool bWallFacingXProperty, const FTileMatrix::FWallSpawnPoint& WallSpawnPoint, const FVector& WallPivotOffsetOverride) const
 {
-	TArray<FRoomTemplate*> RoomTemplates;
-	FString ContextStr;
-	RoomTemplatesDataTable->GetAllRows<FRoomTemplate>(ContextStr, RoomTemplates);
+	FVector WallModifiedOffset = FVector();
+	FRotator WallRotation = CalculateWallRotation(bWallFacingXProperty, WallSpawnPoint, WallPivotOffsetOverride, WallModifiedOffset);
 
-	ensure(RoomTemplates.Num() > 0);
+	FVector WallScale = FVector::OneVector;
+	if (WallSpawnPoint.Length > 1)
+	{
+		//Points facing the X axis are spread along Y. The pivot offset along the wall scales with the mesh
+		if (WallSpawnPoint.bFacingX)
+		{
+			WallModifiedOffset.Y *= WallSpawnPoint.Length;
+		}
+		else
+		{
+			WallModifiedOffset.X *= WallSpawnPoint.Length;
+		}
+
+		//After the rotation, the length of the mesh lies along its local Y axis if the mesh is facing X, and X otherwise
+		if (bWallFacingXProperty)
+		{
+			WallScale.Y = WallSpawnPoint.Length;
+		}
+		else
+		{
+			WallScale.X = WallSpawnPoint.Length;
+		}
+	}
+
+	return FTransform(WallRotation, WallSpawnPoint.WorldLocation + WallModifiedOffset, WallScale);
+}
+
+FTransform ADungeonGenerator::CalculateFloorTransform(const FTileMatrix::FFloorSpawnPoint& FloorSpawnPoint, const FVector& FloorPivotOffsetOverride) const
+{
+	//Rows extend along X and columns along Y. The pivot offset scales with the mesh
+	const FVector FloorScale = FVector(FloorSpawnPoint.Rows, FloorSpawnPoint.Columns, 1.f);
+	return FTransform(FRotator::ZeroRotator, FloorSpawnPoint.WorldLocation + FloorPivotOffsetOverride * FloorScale, FloorScale);
+}
+
+bool ADungeonGenerator::UpdateCompiledRoomTemplates()
+{
+	if (!RoomTemplatesDataTable)
+	{
+		return false;
+	}
+
+	if (bCompiledRoomTemplatesDirty || CompiledRoomTemplatesTable.Get() != RoomTemplatesDataTable)
+	{
+		if (UDataTable* PreviousTable = CompiledRoomTemplatesTable.Get())
+		{
+			PreviousTable->OnDataTableChanged().Remove(RoomTemplatesChangedHandle);
+		}
+		RoomTemplatesChangedHandle = RoomTemplatesDataTable->OnDataTableChanged().AddUObject(this, &ADungeonGenerator::OnRoomTemplatesChanged);
+		CompiledRoomTemplatesTable = RoomTemplatesDataTable;
+		bCompiledRoomTemplatesDirty = false;
+
+		TArray<FRoomTemplate*> RoomTemplates;
+		FString ContextStr;
+		RoomTemplatesDataTable->GetAllRows<FRoomTemplate>(ContextStr, RoomTemplates);
+
+		CompiledRoomTemplates.Reset(RoomTemplates.Num());
+		for (int32 i = 0; i < RoomTemplates.Num(); i++)
+		{
+			const FRoomTemplate& RoomTemplate = *RoomTemplates[i];
+			FCompiledRoomTemplate& CompiledTemplate = CompiledRoomTemplates.AddDefaulted_GetRef();
+			CompiledTemplate.FloorMeshAsset = RoomTemplate.RoomTileMesh;
+			CompiledTemplate.FloorMaterialOverrideAsset = RoomTemplate.RoomTileMeshMaterialOverride;
+			CompiledTemplate.WallMeshAsset = RoomTemplate.WallMesh;
+			CompiledTemplate.WallMaterialOverrideAsset = RoomTemplate.WallMeshMaterialOverride;
+			CompiledTemplate.FloorMesh = nullptr;
+			CompiledTemplate.FloorMaterialOverride = nullptr;
+			CompiledTemplate.FloorPivotOffset = RoomTemplate.RoomTilePivotOffset;
+			CompiledTemplate.WallMesh = nullptr;
+			CompiledTemplate.WallMaterialOverride = nullptr;
+			CompiledTemplate.WallPivotOffset = RoomTemplate.WallMeshPivotOffset;
+			CompiledTemplate.bIsWallFacingX = RoomTemplate.bIsWallFacingX;
+		}
+
+		//The 1st row of the data table is also used for the corridors so its floor drives the tile size.
+		//It's needed before the layout gets projected so it's the only mesh that is loaded right away
+		UStaticMesh* TileSizeMesh = (CompiledRoomTemplates.Num() > 0) ? CompiledRoomTemplates[0].FloorMeshAsset.LoadSynchronous() : nullptr;
+		CompiledRoomTemplatesTileSize = (TileSizeMesh) ? CalculateFloorTileSize(*TileSizeMesh) : 0.f;
+
+		//Retried on the next generation in case the mesh shows up by then
+		bCompiledRoomTemplatesDirty = CompiledRoomTemplatesTileSize <= 0.f;
+	}
+
+	//A path that doesn't load (ie a deleted mesh) would project every tile to the origin
+	return CompiledRoomTemplates.Num() > 0 && CompiledRoomTemplatesTileSize > 0.f;
+}
+
+void ADungeonGenerator::PickRoomTemplates(int32 RoomsNum, TArray<int32>& OutRoomTemplates) const
+{
+	//Same seed as the layout so the same dungeon gets the same templates
+	const FRandomStream TemplateStream(GenerationSeed);
 
-	float DataTableFloorTileSize = CalculateFloorTileSize(*(*RoomTemplates[0]).RoomTileMesh);
+	OutRoomTemplates.Reset(RoomsNum);
+	for (int32 i = 0; i < RoomsNum; i++)
+	{
+		OutRoomTemplates.Add(TemplateStream.RandRange(0, CompiledRoomTemplates.Num() - 1));
+	}
+}
 
-	TArray<FTileMatrix::FRoom> Rooms;
-	TArray<FVector> CorridorFloorTiles;
-	TArray<FTileMatrix::FWallSpawnPoint> CorridorWalls;
-	TileMatrix.ProjectTileMapLocationsToWorld(DataTableFloorTileSize, Rooms, CorridorFloorTiles, CorridorWalls);
+void ADungeonGenerator::ResolveRoomTemplate(FCompiledRoomTemplate& RoomTemplate)
+{
+	RoomTemplate.FloorMesh = RoomTemplate.FloorMeshAsset.Get();
+	RoomTemplate.FloorMaterialOverride = RoomTemplate.FloorMaterialOverrideAsset.Get();
+	RoomTemplate.WallMesh = RoomTemplate.WallMeshAsset.Get();
+	RoomTemplate.WallMaterialOverride = RoomTemplate.WallMaterialOverrideAsset.Get();
+}
+
+void ADungeonGenerator::ReleaseRoomTemplateAssets()
+{
+	if (RoomTemplatesLoadHandle.IsValid())
+	{
+		RoomTemplatesLoadHandle->CancelHandle();
+		RoomTemplatesLoadHandle.Reset();
+	}
+}
+
+void ADungeonGenerator::OnRoomTemplatesChanged()
+{
+	bCompiledRoomTemplatesDirty = true;
+}
+
+void ADungeonGenerator::SpawnDungeonFromDataTable(const TArray<int32>& RoomTemplates, const TArray<FTileMatrix::FRoom>& Rooms, const TArray<FTileMatrix::FFloorSpawnPoint>& CorridorFloorTiles, const TArray<FTileMatrix::FWallSpawnPoint>& CorridorWalls)
+{
+	if (!ensure(CompiledRoomTemplates.Num() > 0 && RoomTemplates.Num() == Rooms.Num()))
+	{
+		return;
+	}
+
+	//The templates must have been picked from the current compiled templates
+	for (int32 i = 0; i < RoomTemplates.Num(); i++)
+	{
+		if (!ensure(CompiledRoomTemplates.IsValidIndex(RoomTemplates[i])))
+		{
+			return;
+		}
+	}
+
+	//The picked templates are loaded by now
+	ResolveRoomTemplate(CompiledRoomTemplates[0]);
+	for (int32 i = 0; i < RoomTemplates.Num(); i++)
+	{
+		ResolveRoomTemplate(CompiledRoomTemplates[RoomTemplates[i]]);
+	}
 
 	//Spawn rooms & walls using a random template from the provided table
 	for (int32 i = 0; i < Rooms.Num(); i++)
 	{
-		FRoomTemplate RoomTemplate = *RoomTemplates[FMath::RandRange(0, RoomTemplates.Num() - 1)];
+		const FCompiledRoomTemplate& RoomTemplate = CompiledRoomTemplates[RoomTemplates[i]];
 
-		for (int32 j = 0; j < Rooms[i].FloorTileWorldLocations.Num(); j++)
+		for (int32 j = 0; j < Rooms[i].FloorSpawnPoints.Num(); j++)
 		{
-			FVector WorldSpawnLocation = Rooms[i].FloorTileWorldLocations[j];
-			SpawnDungeonMesh(FTransform(FRotator::ZeroRotator, WorldSpawnLocation + RoomTemplate.RoomTilePivotOffset), RoomTemplate.RoomTileMesh, RoomTemplate.RoomTileMeshMaterialOverride);
+			FTransform FloorTransform = CalculateFloorTransform(Rooms[i].FloorSpawnPoints[j], RoomTemplate.FloorPivotOffset);
+			QueueDungeonMesh(FloorTransform, RoomTemplate.FloorMesh, RoomTemplate.FloorMaterialOverride, i);
 		}
 
 		for (int32 j = 0; j < Rooms[i].WallSpawnPoints.Num(); j++)
 		{
-			//FVector WorldSpawnLocation = Rooms[i].WallSpawnPoints[j].WorldLocation;
-			FVector WallModifiedOffset = FVector();
-			FRotator WallRotation = CalculateWallRotation(RoomTemplate.bIsWallFacingX, Rooms[i].WallSpawnPoints[j], RoomTemplate.WallMeshPivotOffset, WallModifiedOffset);
-			FVector WallSpawnLocation = Rooms[i].WallSpawnPoints[j].WorldLocation + WallModifiedOffset;
-			SpawnDungeonMesh(FTransform(WallRotation, WallSpawnLocation), RoomTemplate.WallMesh, RoomTemplate.WallMeshMaterialOverride);
+			FTransform WallTransform = CalculateWallTransform(RoomTemplate.bIsWallFacingX, Rooms[i].WallSpawnPoints[j], RoomTemplate.WallPivotOffset);
+			QueueDungeonMesh(WallTransform, RoomTemplate.WallMesh, RoomTemplate.WallMaterialOverride, i);
 		}
 	}
 
 	
-	//Get the 1st element of the data table to retrieve any pivot offsets
-	//The 1st row of the data table will be used to create corridors connecting various spawned rooms
-	FVector FloorTileOffset = RoomTemplates[0]->RoomTilePivotOffset;
-	UStaticMesh* CorridorFloorTile = RoomTemplates[0]->RoomTileMesh;
-	UStaticMesh* CorridorWall = RoomTemplates[0]->WallMesh;
+	//The 1st template will be used to create corridors connecting various spawned rooms
+	const FCompiledRoomTemplate& CorridorTemplate = CompiledRoomTemplates[0];
 
 	//Spawn floor tiles for corridors
 	for (int32 i = 0; i < CorridorFloorTiles.Num(); i++)
 	{
-		//CorridorFloorTiles[i]+=FloorTileOffset;
-		SpawnDungeonMesh(FTransform(FRotator::ZeroRotator,CorridorFloorTiles[i] + FloorTileOffset), CorridorFloorTile);
+		QueueDungeonMesh(CalculateFloorTransform(CorridorFloorTiles[i], CorridorTemplate.FloorPivotOffset), CorridorTemplate.FloorMesh);
 	}
 
-	bool bCorridorWallFacingX = RoomTemplates[0]->bIsWallFacingX;
-	FVector RoomTemplateWallOffset = RoomTemplates[0]->WallMeshPivotOffset;
-
 	//Spawn walls for corridors
 	for (int32 i = 0; i < CorridorWalls.Num(); i++)
 	{
-		FVector WallModifiedOffset = FVector();
-		FRotator WallRotation = CalculateWallRotation(bCorridorWallFacingX, CorridorWalls[i], RoomTemplateWallOffset, WallModifiedOffset);
-		FVector WallSpawnPoint = CorridorWalls[i].WorldLocation + WallModifiedOffset;
-
-		SpawnDungeonMesh(FTransform(WallRotation,WallSpawnPoint), CorridorWall);
+		QueueDungeonMesh(CalculateWallTransform(CorridorTemplate.bIsWallFacingX, CorridorWalls[i], CorridorTemplate.WallPivotOffset), CorridorTemplate.WallMesh);
 	}
+
+	SpawnQueuedDungeonMeshes();
 }
 
-void ADungeonGenerator::SpawnGenericDungeon(const TArray<FVector>& FloorTileLocations, const TArray<FTileMatrix::FWallSpawnPoint>& WallSpawnPoints)
+void ADungeonGenerator::SpawnGenericDungeon(const TArray<FTileMatrix::FFloorSpawnPoint>& FloorTileLocations, const TArray<FTileMatrix::FWallSpawnPoint>& WallSpawnPoints)
 {
 	for (int32 i = 0; i < FloorTileLocations.Num(); i++)
 	{
+		FTransform FloorTransform = CalculateFloorTransform(FloorTileLocations[i], FloorPivotOffset);
+
 		//Draw debug boxes if needed
 #if WITH_EDITOR
 		if (bDebugActive)
 		{
-			DrawDebugBox(GetWorld(), FloorTileLocations[i], DebugVertexBoxExtents, DefaultFloorSpawnLocationColor.ToFColor(true), true, 1555.f, 15);
-			DrawDebugBox(GetWorld(), FloorTileLocations[i] + FloorPivotOffset, DebugVertexBoxExtents, OffsetedFloorSpawnLocationColor.ToFColor(true), true, 1555.f, 15);
+			DrawDebugBox(GetWorld(), FloorTileLocations[i].WorldLocation, DebugVertexBoxExtents, DefaultFloorSpawnLocationColor.ToFColor(true), true, 1555.f, 15);
+			DrawDebugBox(GetWorld(), FloorTransform.GetLocation(), DebugVertexBoxExtents, OffsetedFloorSpawnLocationColor.ToFColor(true), true, 1555.f, 15);
 		}
 #endif
 
-		SpawnDungeonMesh(FTransform(FRotator::ZeroRotator, FloorTileLocations[i] + FloorPivotOffset), FloorSM);
+		QueueDungeonMesh(FloorTransform, FloorSM);
 	}
 	for (int32 i = 0; i < WallSpawnPoints.Num(); i++)
 	{
-		
-		FVector WallModifiedOffset = FVector();
-		FRotator WallRotation = CalculateWallRotation(bWallFacingX, WallSpawnPoints[i], WallSMPivotOffset, WallModifiedOffset);
-		FVector WallSpawnPoint = WallSpawnPoints[i].WorldLocation + WallModifiedOffset;
+		FTransform WallTransform = CalculateWallTransform(bWallFacingX, WallSpawnPoints[i], WallSMPivotOffset);
+		FVector WallSpawnPoint = WallTransform.GetLocation();
 
 		//Draw debug boxes if needed
 #if WITH_EDITOR
@@ -142,33 +274,177 @@ void ADungeonGenerator::SpawnGenericDungeon(const TArray<FVector>& FloorTileLoca
 		}
 #endif
 
-		SpawnDungeonMesh(FTransform(WallRotation,WallSpawnPoint),WallSM);
+		QueueDungeonMesh(WallTransform, WallSM);
 	}
 
-	if (OnDungeonSpawned.IsBound())
+	SpawnQueuedDungeonMeshes();
+}
+
+void ADungeonGenerator::DestroySpawnedGroup(FDungeonSpawnedGroup& Group)
+{
+	for (int32 i = Group.Actors.Num() - 1; i >= 0; i--)
 	{
-		OnDungeonSpawned.Broadcast();
+		if (IsValid(Group.Actors[i]))
+		{
+			ReleaseMeshActor(Group.Actors[i]);
+		}
+	}
+	Group.Actors.Empty();
+
+	for (int32 i = 0; i < Group.MergedMeshComponents.Num(); i++)
+	{
+		if (IsValid(Group.MergedMeshComponents[i]))
+		{
+			Group.MergedMeshComponents[i]->DestroyComponent();
+		}
 	}
+	Group.MergedMeshComponents.Empty();
 }
 
 void ADungeonGenerator::DestroyDungeonMeshes()
 {
-	//Erase previously spawned stuff
-	TArray<AActor*> SpawnedActors;
-	//const UWorld* World = GetWorld();
-	UGameplayStatics::GetAllActorsOfClassWithTag(this, AActor::StaticClass(), DUNGEON_MESH_TAG, SpawnedActors);
+	ReleaseRoomTemplateAssets();
+
+	//Erase previously spawned stuff. Only what this generator spawned is touched
+	for (TPair<int32, FDungeonSpawnedGroup>& SpawnedGroup : SpawnedGroups)
+	{
+		DestroySpawnedGroup(SpawnedGroup.Value);
+	}
+	SpawnedGroups.Empty();
+
+	//Keep the instanced components around; the next dungeon will most likely use the same meshes
+	for (int32 i = 0; i < InstancedMeshComponents.Num(); i++)
+	{
+		if (InstancedMeshComponents[i])
+		{
+			InstancedMeshComponents[i]->ClearInstances();
+		}
+	}
+
+	ClearSpawnQueue();
+}
+
+bool ADungeonGenerator::DestroyDungeonRoom(int32 Room)
+{
+	if (Room == INDEX_NONE)
+	{
+		return false;
+	}
+
+	if (SpawnMode == EDungeonSpawnMode::InstancedMeshes)
+	{
+		UE_LOG(DungeonGenerator, Warning, TEXT("Cannot destroy room %d. The rooms of instanced dungeons share the same components"), Room);
+		return false;
+	}
+
+	//Meshes of the room that are still waiting to be spawned are dropped too
+	bool bDroppedQueuedMeshes = false;
+	for (int32 i = SpawnChunks.Num() - 1; i >= NextSpawnChunk; i--)
+	{
+		if (QueuedMeshBatches[SpawnChunks[i].BatchIndex].SpawnGroup == Room)
+		{
+			QueuedMeshesNum -= SpawnChunks[i].TransformsNum - ((i == NextSpawnChunk) ? NextChunkTransform : 0);
+			if (i == NextSpawnChunk)
+			{
+				NextChunkTransform = 0;
+			}
+			SpawnChunks.RemoveAt(i);
+			bDroppedQueuedMeshes = true;
+		}
+	}
+	if (bDroppedQueuedMeshes && NextSpawnChunk == SpawnChunks.Num())
+	{
+		//Nothing else is waiting so finish the spawn right away
+		DrainSpawnQueue(0.0);
+	}
+
+	FDungeonSpawnedGroup RoomGroup;
+	if (!SpawnedGroups.RemoveAndCopyValue(Room, RoomGroup))
+	{
+		return bDroppedQueuedMeshes;
+	}
+
+	DestroySpawnedGroup(RoomGroup);
+	return true;
+}
+
+bool ADungeonGenerator::CanPoolMeshActors() const
+{
+	const UWorld* World = GetWorld();
+	return bPoolMeshActors && World && World->IsGameWorld();
+}
+
+void ADungeonGenerator::ReleaseMeshActor(AStaticMeshActor* SMActor)
+{
+	if (!CanPoolMeshActors() || PooledMeshActors.Num() >= MaxPooledMeshActors)
+	{
+		SMActor->Destroy();
+		MeshPoolStats.Destroyed++;
+		return;
+	}
 
-	for (int32 i = SpawnedActors.Num() - 1; i >= 0; i--)
+	SMActor->SetActorHiddenInGame(true);
+	SMActor->SetActorEnableCollision(false);
+	PooledMeshActors.Add(SMActor);
+	MeshPoolStats.Released++;
+}
+
+void ADungeonGenerator::TrimMeshActorPool(int32 MaxPooledActors)
+{
+	MaxPooledActors = FMath::Max(MaxPooledActors, 0);
+	for (int32 i = MaxPooledActors; i < PooledMeshActors.Num(); i++)
 	{
-		if (SpawnedActors[i])
+		if (IsValid(PooledMeshActors[i]))
 		{
-			SpawnedActors[i]->Destroy();
+			PooledMeshActors[i]->Destroy();
+			MeshPoolStats.Destroyed++;
 		}
 	}
+	if (PooledMeshActors.Num() > MaxPooledActors)
+	{
+		PooledMeshActors.SetNum(MaxPooledActors);
+	}
+}
+
+void ADungeonGenerator::EmptyMeshActorPool()
+{
+	TrimMeshActorPool(0);
+	PooledMeshActors.Empty();
+}
+
+FDungeonMeshPoolStats ADungeonGenerator::GetMeshPoolStats() const
+{
+	FDungeonMeshPoolStats Stats = MeshPoolStats;
+	Stats.PooledActorsNum = PooledMeshActors.Num();
+	return Stats;
 }
 
 AStaticMeshActor* ADungeonGenerator::SpawnDungeonMesh(const FTransform& InTransform, UStaticMesh* SMToSpawn, UMaterialInterface* OverrideMaterial)
 {
+	//Actors of the pool are destroyed along with the world so check they're still around
+	while (PooledMeshActors.Num() > 0)
+	{
+		AStaticMeshActor* PooledActor = PooledMeshActors.Pop();
+		if (!IsValid(PooledActor))
+		{
+			continue;
+		}
+
+		UStaticMeshComponent* SMComponent = PooledActor->GetStaticMeshComponent();
+		SMComponent->SetStaticMesh(SMToSpawn);
+		SMComponent->EmptyOverrideMaterials();
+		if (OverrideMaterial)
+		{
+			SMComponent->SetMaterial(0, OverrideMaterial);
+		}
+		PooledActor->SetActorTransform(InTransform);
+		PooledActor->SetActorEnableCollision(true);
+		PooledActor->SetActorHiddenInGame(false);
+		MeshPoolStats.Hits++;
+		return PooledActor;
+	}
+	MeshPoolStats.Misses++;
+
 	FActorSpawnParameters ActorSpawnParams;
 	ActorSpawnParams.Owner = this;
 
@@ -179,6 +455,9 @@ AStaticMeshActor* ADungeonGenerator::SpawnDungeonMesh(const FTransform& InTransf
 		//Meshes will switch static if used from within the editor
 		SMActor->SetMobility(EComponentMobility::Movable);
 
+		//Every machine spawns its own meshes from the replicated GenerationDescriptor
+		SMActor->SetReplicates(false);
+
 		SMActor->GetStaticMeshComponent()->SetStaticMesh(SMToSpawn);
 
 		if (OverrideMaterial)
@@ -191,11 +470,335 @@ AStaticMeshActor* ADungeonGenerator::SpawnDungeonMesh(const FTransform& InTransf
 	return SMActor;
 }
 
+void ADungeonGenerator::QueueDungeonMesh(const FTransform& InTransform, UStaticMesh* SMToSpawn, UMaterialInterface* OverrideMaterial, int32 SpawnGroup)
+{
+	//Consecutive meshes usually share the same batch so check the last one first
+	for (int32 i = QueuedMeshBatches.Num() - 1; i >= 0; i--)
+	{
+		if (QueuedMeshBatches[i].Mesh == SMToSpawn && QueuedMeshBatches[i].MaterialOverride == OverrideMaterial && QueuedMeshBatches[i].SpawnGroup == SpawnGroup)
+		{
+			QueuedMeshBatches[i].Transforms.Add(InTransform);
+			QueuedMeshesNum++;
+			return;
+		}
+	}
+
+	FDungeonMeshBatch& NewBatch = QueuedMeshBatches.AddDefaulted_GetRef();
+	NewBatch.Mesh = SMToSpawn;
+	NewBatch.MaterialOverride = OverrideMaterial;
+	NewBatch.SpawnGroup = SpawnGroup;
+	NewBatch.Transforms.Add(InTransform);
+	QueuedMeshesNum++;
+}
+
+FVector ADungeonGenerator::GetSpawnViewLocation() const
+{
+	if (const APlayerCameraManager* CameraManager = UGameplayStatics::GetPlayerCameraManager(this, 0))
+	{
+		return CameraManager->GetCameraLocation();
+	}
+	if (const APawn* PlayerPawn = UGameplayStatics::GetPlayerPawn(this, 0))
+	{
+		return PlayerPawn->GetActorLocation();
+	}
+	return GetActorLocation();
+}
+
+void ADungeonGenerator::SpawnQueuedDungeonMeshes()
+{
+	if (SpawnMode == EDungeonSpawnMode::MergedMeshes)
+	{
+		//The merge is built in one go, in parallel across the merged meshes
+		SpawnMergedDungeonMeshes();
+		ClearSpawnQueue();
+
+		if (OnDungeonSpawned.IsBound())
+		{
+			OnDungeonSpawned.Broadcast();
+		}
+		return;
+	}
+
+	const FVector ViewLocation = GetSpawnViewLocation();
+
+	//Closest transforms first inside each batch, then split the batches in chunks and order the chunks by their closest transform
+	SpawnChunks.Reset();
+	for (int32 i = 0; i < QueuedMeshBatches.Num(); i++)
+	{
+		TArray<FTransform>& Transforms = QueuedMeshBatches[i].Transforms;
+		Transforms.Sort([&ViewLocation](const FTransform& A, const FTransform& B)
+		{
+			return FVector::DistSquared(A.GetLocation(), ViewLocation) < FVector::DistSquared(B.GetLocation(), ViewLocation);
+		});
+
+		for (int32 j = 0; j < Transforms.Num(); j += SpawnChunkSize)
+		{
+			FDungeonSpawnChunk& Chunk = SpawnChunks.AddDefaulted_GetRef();
+			Chunk.BatchIndex = i;
+			Chunk.FirstTransform = j;
+			Chunk.TransformsNum = FMath::Min(SpawnChunkSize, Transforms.Num() - j);
+			Chunk.DistanceSquared = FVector::DistSquared(Transforms[j].GetLocation(), ViewLocation);
+		}
+	}
+	SpawnChunks.StableSort([](const FDungeonSpawnChunk& A, const FDungeonSpawnChunk& B)
+	{
+		return A.DistanceSquared < B.DistanceSquared;
+	});
+	NextSpawnChunk = 0;
+	NextChunkTransform = 0;
+	SpawnedMeshesNum = 0;
+
+	//The editor doesn't tick actors so anything generated there is spawned right away
+	const UWorld* World = GetWorld();
+	if (SpawnFrameBudgetMs > 0.f && World && World->IsGameWorld())
+	{
+		DrainSpawnQueue(SpawnFrameBudgetMs / 1000.0);
+		if (SpawnChunks.Num() > 0)
+		{
+			SetActorTickEnabled(true);
+		}
+	}
+	else
+	{
+		DrainSpawnQueue(0.0);
+	}
+}
+
+void ADungeonGenerator::DrainSpawnQueue(double BudgetSeconds)
+{
+	const double EndTime = FPlatformTime::Seconds() + BudgetSeconds;
+	const int32 FirstSpawnedMeshesNum = SpawnedMeshesNum;
+
+	//Every call spawns at least one mesh so the queue keeps moving even when a single spawn takes longer than the budget
+	auto IsOverBudget = [this, BudgetSeconds, EndTime, FirstSpawnedMeshesNum]()
+	{
+		return BudgetSeconds > 0.0 && SpawnedMeshesNum > FirstSpawnedMeshesNum && FPlatformTime::Seconds() >= EndTime;
+	};
+
+	while (NextSpawnChunk < SpawnChunks.Num() && !IsOverBudget())
+	{
+		const FDungeonSpawnChunk& Chunk = SpawnChunks[NextSpawnChunk];
+		const FDungeonMeshBatch& Batch = QueuedMeshBatches[Chunk.BatchIndex];
+
+		if (SpawnMode == EDungeonSpawnMode::InstancedMeshes)
+		{
+			//A chunk of instances is cheap enough to be added in one go
+			UHierarchicalInstancedStaticMeshComponent* InstancedMeshComponent = FindOrCreateInstancedMeshComponent(Batch.Mesh, Batch.MaterialOverride);
+			if (InstancedMeshComponent)
+			{
+				TArray<FTransform> ChunkTransforms(Batch.Transforms.GetData() + Chunk.FirstTransform, Chunk.TransformsNum);
+				InstancedMeshComponent->AddInstances(ChunkTransforms, false, true);
+			}
+			SpawnedMeshesNum += Chunk.TransformsNum;
+			NextChunkTransform = Chunk.TransformsNum;
+		}
+		else
+		{
+			TArray<AStaticMeshActor*>& GroupActors = SpawnedGroups.FindOrAdd(Batch.SpawnGroup).Actors;
+			for (; NextChunkTransform < Chunk.TransformsNum; NextChunkTransform++)
+			{
+				if (IsOverBudget())
+				{
+					break;
+				}
+				if (AStaticMeshActor* SMActor = SpawnDungeonMesh(Batch.Transforms[Chunk.FirstTransform + NextChunkTransform], Batch.Mesh, Batch.MaterialOverride))
+				{
+					GroupActors.Add(SMActor);
+				}
+				SpawnedMeshesNum++;
+			}
+		}
+
+		if (NextChunkTransform == Chunk.TransformsNum)
+		{
+			NextSpawnChunk++;
+			NextChunkTransform = 0;
+		}
+	}
+
+	if (BudgetSeconds > 0.0 && OnDungeonSpawnProgress.IsBound())
+	{
+		OnDungeonSpawnProgress.Broadcast(SpawnedMeshesNum, QueuedMeshesNum);
+	}
+
+	if (NextSpawnChunk == SpawnChunks.Num())
+	{
+		ClearSpawnQueue();
+
+		//Whatever the new dungeon didn't reuse is left over from a bigger dungeon
+		TrimMeshActorPool(PooledMeshActorsSlack);
+
+		if (OnDungeonSpawned.IsBound())
+		{
+			OnDungeonSpawned.Broadcast();
+		}
+	}
+}
+
+void ADungeonGenerator::SpawnMergedDungeonMeshes()
+{
+	FDungeonMeshMerger Merger;
+
+	//Each room gets its own mesh. Everything else is merged per cell
+	TMap<int32, int32> RoomGroups;
+	TMap<FIntPoint, int32> CellGroups;
+	const float CellSize = FMath::Max(MergedMeshCellSize, 100.f);
+
+	//The spawn group of each merger group
+	TArray<int32> GroupSpawnGroups;
+
+	for (int32 i = 0; i < QueuedMeshBatches.Num(); i++)
+	{
+		const FDungeonMeshBatch& Batch = QueuedMeshBatches[i];
+
+		if (Batch.SpawnGroup != INDEX_NONE)
+		{
+			const int32* FoundGroup = RoomGroups.Find(Batch.SpawnGroup);
+			const int32 Group = FoundGroup ? *FoundGroup : RoomGroups.Add(Batch.SpawnGroup, GroupSpawnGroups.Add(Batch.SpawnGroup));
+			Merger.AddMeshes(Group, Batch.Mesh, Batch.MaterialOverride, Batch.Transforms);
+			continue;
+		}
+
+		TMap<int32, TArray<FTransform>> GroupTransforms;
+		for (int32 j = 0; j < Batch.Transforms.Num(); j++)
+		{
+			const FVector Location = Batch.Transforms[j].GetLocation();
+			const FIntPoint Cell = FIntPoint(FMath::FloorToInt(Location.X / CellSize), FMath::FloorToInt(Location.Y / CellSize));
+
+			const int32* FoundGroup = CellGroups.Find(Cell);
+			const int32 Group = FoundGroup ? *FoundGroup : CellGroups.Add(Cell, GroupSpawnGroups.Add(INDEX_NONE));
+			GroupTransforms.FindOrAdd(Group).Add(Batch.Transforms[j]);
+		}
+
+		for (const TPair<int32, TArray<FTransform>>& Transforms : GroupTransforms)
+		{
+			Merger.AddMeshes(Transforms.Key, Batch.Mesh, Batch.MaterialOverride, Transforms.Value);
+		}
+	}
+
+	Merger.Build();
+
+	for (int32 i = 0; i < Merger.GetGroupsNum(); i++)
+	{
+		if (UProceduralMeshComponent* MergedMeshComponent = CreateMergedMeshComponent(Merger, i))
+		{
+			SpawnedGroups.FindOrAdd(GroupSpawnGroups[i]).MergedMeshComponents.Add(MergedMeshComponent);
+		}
+	}
+}
+
+UProceduralMeshComponent* ADungeonGenerator::CreateMergedMeshComponent(const FDungeonMeshMerger& Merger, int32 Group)
+{
+	const TArray<FDungeonMeshMerger::FMergedSection>& Sections = Merger.GetGroupSections(Group);
+	if (Sections.Num() == 0)
+	{
+		return nullptr;
+	}
+
+	UProceduralMeshComponent* MergedMeshComponent = NewObject<UProceduralMeshComponent>(this);
+	if (!MergedMeshComponent)
+	{
+		return nullptr;
+	}
+
+	//The merged vertices are relative to the group origin in world space
+	MergedMeshComponent->SetMobility(EComponentMobility::Movable);
+	MergedMeshComponent->bUseAsyncCooking = true;
+	MergedMeshComponent->SetUsingAbsoluteLocation(true);
+	MergedMeshComponent->SetUsingAbsoluteRotation(true);
+	MergedMeshComponent->SetUsingAbsoluteScale(true);
+	MergedMeshComponent->SetupAttachment(RootComponent);
+	MergedMeshComponent->RegisterComponent();
+	MergedMeshComponent->SetWorldLocation(Merger.GetGroupOrigin(Group));
+	AddInstanceComponent(MergedMeshComponent);
+
+	for (int32 i = 0; i < Sections.Num(); i++)
+	{
+		const FDungeonMeshMerger::FMergedSection& Section = Sections[i];
+		MergedMeshComponent->CreateMeshSection(i, Section.Vertices, Section.Triangles, Section.Normals, Section.UVs, TArray<FColor>(), Section.Tangents, bCreateMergedMeshCollision);
+		MergedMeshComponent->SetMaterial(i, Section.Material);
+	}
+
+	return MergedMeshComponent;
+}
+
+void ADungeonGenerator::ClearSpawnQueue()
+{
+	QueuedMeshBatches.Empty();
+	SpawnChunks.Empty();
+	NextSpawnChunk = 0;
+	NextChunkTransform = 0;
+	SpawnedMeshesNum = 0;
+	QueuedMeshesNum = 0;
+	SetActorTickEnabled(false);
+}
+
+void ADungeonGenerator::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	if (SpawnChunks.Num() > 0)
+	{
+		DrainSpawnQueue(FMath::Max(SpawnFrameBudgetMs, 0.f) / 1000.0);
+	}
+	else
+	{
+		SetActorTickEnabled(false);
+	}
+}
+
+UHierarchicalInstancedStaticMeshComponent* ADungeonGenerator::FindOrCreateInstancedMeshComponent(UStaticMesh* SMToSpawn, UMaterialInterface* OverrideMaterial)
+{
+	if (!SMToSpawn)
+	{
+		return nullptr;
+	}
+
+	//Only the 1st material can be overridden so components that end up with the same 1st material are interchangeable
+	UMaterialInterface* Material = (OverrideMaterial) ? OverrideMaterial : SMToSpawn->GetMaterial(0);
+	for (int32 i = 0; i < InstancedMeshComponents.Num(); i++)
+	{
+		UHierarchicalInstancedStaticMeshComponent* InstancedMeshComponent = InstancedMeshComponents[i];
+		if (InstancedMeshComponent && InstancedMeshComponent->GetStaticMesh() == SMToSpawn && InstancedMeshComponent->GetMaterial(0) == Material)
+		{
+			return InstancedMeshComponent;
+		}
+	}
+
+	UHierarchicalInstancedStaticMeshComponent* InstancedMeshComponent = NewObject<UHierarchicalInstancedStaticMeshComponent>(this);
+	if (!InstancedMeshComponent)
+	{
+		return nullptr;
+	}
+
+	//Same as SpawnDungeonMesh. Assign everything before registering the component
+	InstancedMeshComponent->SetMobility(EComponentMobility::Movable);
+	InstancedMeshComponent->SetStaticMesh(SMToSpawn);
+	if (OverrideMaterial)
+	{
+		InstancedMeshComponent->SetMaterial(0, OverrideMaterial);
+	}
+	InstancedMeshComponent->SetupAttachment(RootComponent);
+	InstancedMeshComponent->RegisterComponent();
+	AddInstanceComponent(InstancedMeshComponent);
+
+	InstancedMeshComponents.Add(InstancedMeshComponent);
+	return InstancedMeshComponent;
+}
+
 // Sets default values
 ADungeonGenerator::ADungeonGenerator()
 {
 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = false;
+	//Only ticks while a time-sliced spawn is in progress
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
+
+	//Only the generation descriptor is replicated. Meshes are spawned locally on every machine
+	bReplicates = true;
+
+	//Instanced meshes are attached here
+	RootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("DungeonRoot"));
 
 }
 
@@ -218,43 +821,431 @@ void ADungeonGenerator::PostEditChangeProperty(FPropertyChangedEvent& PropertyCh
 }
 #endif
 
-void ADungeonGenerator::GenerateDungeon()
+void ADungeonGenerator::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-	
-	TileMatrix = FTileMatrix(TileMapRows, TileMapColumns);
-	TileMatrix.MaxRandomAttemptsPerRoom = MaxRandomAttemptsPerRoom;
-	TileMatrix.SetRoomSize(MinRoomSize, MaxRoomSize);
+	CancelDungeonGeneration();
+	ReleaseRoomTemplateAssets();
+	EmptyMeshActorPool();
 
-	TileMatrix.CreateRooms(RoomsToGenerate);
-	DestroyDungeonMeshes();
+	Super::EndPlay(EndPlayReason);
+}
 
+bool ADungeonGenerator::GetSpawnTileSize(float& OutTileSize)
+{
 	if (RoomTemplatesDataTable)
 	{
-		SpawnDungeonFromDataTable();
+		if (!UpdateCompiledRoomTemplates())
+		{
+			UE_LOG(DungeonGenerator, Warning, TEXT("Cannot generate dungeon"));
+			UE_LOG(DungeonGenerator, Error, TEXT("Invalid RoomTemplatesDataTable. Verify the 1st row has a valid room tile mesh"));
+			return false;
+		}
+
+		OutTileSize = CompiledRoomTemplatesTileSize;
+		return true;
+	}
+
+	if (!FloorSM)
+	{
+		UE_LOG(DungeonGenerator, Warning, TEXT("Cannot generate dungeon"));
+		UE_LOG(DungeonGenerator, Error, TEXT("Invalid FloorSM. Verify you have assigned a valid floor mesh"));
+		return false;
+	}
+
+	if (!WallSM)
+	{
+		UE_LOG(DungeonGenerator, Warning, TEXT("Cannot generate dungeon"));
+		UE_LOG(DungeonGenerator, Error, TEXT("Invalid WallSM. Verify you have assigned a valid wall mesh"));
+		return false;
+	}
+
+	OutTileSize = FloorTileSize;
+	return true;
+}
+
+void ADungeonGenerator::PickGenerationSeed()
+{
+	GenerationSeed = (bUseRandomSeed) ? FMath::Rand() : Seed;
+}
+
+void ADungeonGenerator::ConfigureTileMatrix(FTileMatrix& InTileMatrix) const
+{
+	InTileMatrix = FTileMatrix(TileMapRows, TileMapColumns);
+	InTileMatrix.RandomStream.Initialize(GenerationSeed);
+	InTileMatrix.MaxRandomAttemptsPerRoom = MaxRandomAttemptsPerRoom;
+	InTileMatrix.bUseFreeSpaceIndex = bUseFreeSpaceIndex;
+	InTileMatrix.CorridorStyle = static_cast<FTileMatrix::ECorridorStyle>(CorridorStyle);
+	InTileMatrix.RoomConnectivity = static_cast<FTileMatrix::ERoomConnectivity>(RoomConnectivity);
+	InTileMatrix.ExtraConnectionsRatio = ExtraConnectionsRatio;
+	InTileMatrix.ConnectionCandidatesPerRoom = ConnectionCandidatesPerRoom;
+	InTileMatrix.bMergeWalls = bMergeWalls;
+	InTileMatrix.MaxWallSegmentLength = MaxWallSegmentLength;
+	InTileMatrix.bMergeFloors = bMergeFloors;
+	InTileMatrix.MaxFloorRectSize = MaxFloorRectSize;
+	InTileMatrix.SetRoomSize(MinRoomSize, MaxRoomSize);
+}
+
+uint32 ADungeonGenerator::GetLayoutCacheKey() const
+{
+	const int32 LayoutProperties[] =
+	{
+		static_cast<int32>(FTileMatrix::ELayoutVersion::LatestVersion),
+		GenerationSeed,
+		TileMapRows,
+		TileMapColumns,
+		MinRoomSize,
+		MaxRoomSize,
+		RoomsToGenerate,
+		MaxRandomAttemptsPerRoom,
+		bUseFreeSpaceIndex,
+		static_cast<int32>(CorridorStyle),
+		static_cast<int32>(RoomConnectivity),
+		ConnectionCandidatesPerRoom
+	};
+	return FCrc::MemCrc32(&ExtraConnectionsRatio, sizeof(ExtraConnectionsRatio), FCrc::MemCrc32(LayoutProperties, sizeof(LayoutProperties)));
+}
+
+void ADungeonGenerator::GenerateLayout(FTileMatrix& InTileMatrix, int32 RoomsNum, uint32 LayoutCacheKey, bool bUseLayoutCache, bool bUseLayoutFiles)
+{
+	if (bUseLayoutCache && FDungeonLayoutCache::Get().Find(LayoutCacheKey, InTileMatrix, bUseLayoutFiles))
+	{
+		return;
+	}
+
+	InTileMatrix.CreateRooms(RoomsNum);
+
+	//Cancelled layouts are incomplete
+	if (bUseLayoutCache && !InTileMatrix.IsCancelled())
+	{
+		FDungeonLayoutCache::Get().Add(LayoutCacheKey, InTileMatrix, bUseLayoutFiles);
+	}
+}
+
+void ADungeonGenerator::ProjectTileMatrix(FTileMatrix& InTileMatrix, float TileSize, bool bSplitRooms, FDungeonSpawnData& OutSpawnData)
+{
+	if (bSplitRooms)
+	{
+		InTileMatrix.ProjectTileMapLocationsToWorld(TileSize, OutSpawnData.Rooms, OutSpawnData.FloorTileLocations, OutSpawnData.WallSpawnPoints);
 	}
 	else
 	{
-		if (!FloorSM)
+		InTileMatrix.ProjectTileMapLocationsToWorld(TileSize, OutSpawnData.FloorTileLocations, OutSpawnData.WallSpawnPoints);
+	}
+}
+
+void ADungeonGenerator::SpawnDungeon(FDungeonSpawnData&& SpawnData)
+{
+	DestroyDungeonMeshes();
+
+	if (!RoomTemplatesDataTable)
+	{
+		SpawnGenericDungeon(SpawnData.FloorTileLocations, SpawnData.WallSpawnPoints);
+		return;
+	}
+
+	if (!UpdateCompiledRoomTemplates())
+	{
+		UE_LOG(DungeonGenerator, Error, TEXT("Invalid RoomTemplatesDataTable. Verify the 1st row has a valid room tile mesh"));
+		return;
+	}
+
+	//Pick the templates first so only the assets of the picked templates get loaded. The 1st template is also used by the corridors
+	TArray<int32> RoomTemplates;
+	PickRoomTemplates(SpawnData.Rooms.Num(), RoomTemplates);
+
+	TArray<bool> IsTemplatePicked;
+	IsTemplatePicked.Init(false, CompiledRoomTemplates.Num());
+	IsTemplatePicked[0] = true;
+	for (int32 i = 0; i < RoomTemplates.Num(); i++)
+	{
+		IsTemplatePicked[RoomTemplates[i]] = true;
+	}
+
+	TArray<FSoftObjectPath> AssetsToLoad;
+	for (int32 i = 0; i < CompiledRoomTemplates.Num(); i++)
+	{
+		if (!IsTemplatePicked[i])
+		{
+			continue;
+		}
+		const FCompiledRoomTemplate& RoomTemplate = CompiledRoomTemplates[i];
+		const FSoftObjectPath TemplateAssets[4] = { RoomTemplate.FloorMeshAsset.ToSoftObjectPath(), RoomTemplate.FloorMaterialOverrideAsset.ToSoftObjectPath(),
+			RoomTemplate.WallMeshAsset.ToSoftObjectPath(), RoomTemplate.WallMaterialOverrideAsset.ToSoftObjectPath() };
+		for (int32 j = 0; j < 4; j++)
+		{
+			if (TemplateAssets[j].IsValid())
+			{
+				AssetsToLoad.AddUnique(TemplateAssets[j]);
+			}
+		}
+	}
+
+	FStreamableManager& StreamableManager = UAssetManager::GetStreamableManager();
+
+	//The editor doesn't wait for anything so dungeons generated there are loaded & spawned right away
+	const UWorld* World = GetWorld();
+	if (!World || !World->IsGameWorld())
+	{
+		RoomTemplatesLoadHandle = StreamableManager.RequestSyncLoad(AssetsToLoad);
+		SpawnDungeonFromDataTable(RoomTemplates, SpawnData.Rooms, SpawnData.FloorTileLocations, SpawnData.WallSpawnPoints);
+		return;
+	}
+
+	//Spawns once every asset has arrived. Cancelled along with the handle if the dungeon gets destroyed or regenerated first (see CancelDungeonGeneration)
+	TSharedRef<FDungeonSpawnData> PendingSpawnData = MakeShared<FDungeonSpawnData>(MoveTemp(SpawnData));
+	const uint32 RequestId = GenerationId;
+	RoomTemplatesLoadHandle = StreamableManager.RequestAsyncLoad(AssetsToLoad, FStreamableDelegate::CreateWeakLambda(this, [this, RequestId, RoomTemplates, PendingSpawnData]()
+	{
+		//A newer generation may have rebuilt the compiled templates the indices point to
+		if (GenerationId != RequestId)
 		{
-			UE_LOG(DungeonGenerator, Warning, TEXT("Cannot generate dungeon"));
-			UE_LOG(DungeonGenerator, Error, TEXT("Invalid FloorSM. Verify you have assigned a valid floor mesh"));
 			return;
 		}
+		SpawnDungeonFromDataTable(RoomTemplates, PendingSpawnData->Rooms, PendingSpawnData->FloorTileLocations, PendingSpawnData->WallSpawnPoints);
+	}));
+}
+
+void ADungeonGenerator::GenerateDungeon()
+{
+	//Anything that is still generating in the background is outdated now
+	CancelDungeonGeneration();
+	GenerationId++;
+
+	float TileSize;
+	if (!GetSpawnTileSize(TileSize))
+	{
+		return;
+	}
+
+	PickGenerationSeed();
+	ConfigureTileMatrix(TileMatrix);
+
+	//Random seeds would only fill the cache with layouts that are never requested again
+	const bool bUseLayoutCache = bCacheLayouts && !bUseRandomSeed;
+	GenerateLayout(TileMatrix, RoomsToGenerate, GetLayoutCacheKey(), bUseLayoutCache, bCacheLayoutsOnDisk);
+
+	FDungeonSpawnData SpawnData;
+	ProjectTileMatrix(TileMatrix, TileSize, RoomTemplatesDataTable != nullptr, SpawnData);
+	GeneratedTileSize = TileSize;
+	OnTileMatrixGenerated();
+	SpawnDungeon(MoveTemp(SpawnData));
+}
+
+void ADungeonGenerator::GenerateDungeonAsync()
+{
+	CancelDungeonGeneration();
+	const uint32 RequestId = ++GenerationId;
+
+	float TileSize;
+	if (!GetSpawnTileSize(TileSize))
+	{
+		return;
+	}
+
+	//Everything the worker needs is gathered here so it never touches the actor
+	TSharedRef<FTileMatrix, ESPMode::ThreadSafe> AsyncTileMatrix = MakeShared<FTileMatrix, ESPMode::ThreadSafe>();
+	PickGenerationSeed();
+	ConfigureTileMatrix(*AsyncTileMatrix);
+	AsyncGenerationCancellationFlag = MakeShared<std::atomic<bool>, ESPMode::ThreadSafe>(false);
+	AsyncTileMatrix->CancellationFlag = AsyncGenerationCancellationFlag.Get();
+
+	TSharedPtr<std::atomic<bool>, ESPMode::ThreadSafe> CancellationFlag = AsyncGenerationCancellationFlag;
+	TWeakObjectPtr<ADungeonGenerator> WeakThis(this);
+	const int32 RoomsNum = RoomsToGenerate;
+	const bool bSplitRooms = RoomTemplatesDataTable != nullptr;
+	const uint32 LayoutCacheKey = GetLayoutCacheKey();
+	const bool bUseLayoutCache = bCacheLayouts && !bUseRandomSeed;
+	const bool bUseLayoutFiles = bCacheLayoutsOnDisk;
+
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [WeakThis, RequestId, AsyncTileMatrix, CancellationFlag, RoomsNum, TileSize, bSplitRooms, LayoutCacheKey, bUseLayoutCache, bUseLayoutFiles]()
+	{
+		GenerateLayout(*AsyncTileMatrix, RoomsNum, LayoutCacheKey, bUseLayoutCache, bUseLayoutFiles);
+
+		TSharedRef<FDungeonSpawnData, ESPMode::ThreadSafe> SpawnData = MakeShared<FDungeonSpawnData, ESPMode::ThreadSafe>();
+		if (!CancellationFlag->load())
+		{
+			ProjectTileMatrix(*AsyncTileMatrix, TileSize, bSplitRooms, *SpawnData);
+		}
+		AsyncTileMatrix->CancellationFlag = nullptr;
 
-		if (!WallSM)
+		if (CancellationFlag->load())
 		{
-			UE_LOG(DungeonGenerator, Warning, TEXT("Cannot generate dungeon"));
-			UE_LOG(DungeonGenerator, Error, TEXT("Invalid WallSM. Verify you have assigned a valid wall mesh"));
 			return;
 		}
 
-		TArray<FVector> FloorTiles;
-		TArray<FTileMatrix::FWallSpawnPoint> WallSpawnPoints;
-		TileMatrix.ProjectTileMapLocationsToWorld(FloorTileSize, FloorTiles, WallSpawnPoints);
-		SpawnGenericDungeon(FloorTiles, WallSpawnPoints);
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, RequestId, AsyncTileMatrix, CancellationFlag, SpawnData, TileSize]()
+		{
+			ADungeonGenerator* Generator = WeakThis.Get();
+			if (!Generator || CancellationFlag->load() || Generator->GenerationId != RequestId)
+			{
+				return;
+			}
+
+			Generator->AsyncGenerationCancellationFlag.Reset();
+			Generator->TileMatrix = MoveTemp(*AsyncTileMatrix);
+			Generator->GeneratedTileSize = TileSize;
+			Generator->OnTileMatrixGenerated();
+			Generator->SpawnDungeon(MoveTemp(*SpawnData));
+		});
+	});
+}
+
+void ADungeonGenerator::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(ADungeonGenerator, GenerationDescriptor);
+}
+
+void ADungeonGenerator::OnTileMatrixGenerated()
+{
+	const int32 LayoutHash = static_cast<int32>(TileMatrix.GetLayoutHash());
+
+	if (HasAuthority())
+	{
+		GenerationDescriptor.Seed = GenerationSeed;
+		GenerationDescriptor.TileMapRows = TileMapRows;
+		GenerationDescriptor.TileMapColumns = TileMapColumns;
+		GenerationDescriptor.MinRoomSize = MinRoomSize;
+		GenerationDescriptor.MaxRoomSize = MaxRoomSize;
+		GenerationDescriptor.RoomsToGenerate = RoomsToGenerate;
+		GenerationDescriptor.MaxRandomAttemptsPerRoom = MaxRandomAttemptsPerRoom;
+		GenerationDescriptor.bUseFreeSpaceIndex = bUseFreeSpaceIndex;
+		GenerationDescriptor.CorridorStyle = CorridorStyle;
+		GenerationDescriptor.RoomConnectivity = RoomConnectivity;
+		GenerationDescriptor.ExtraConnectionsRatio = ExtraConnectionsRatio;
+		GenerationDescriptor.ConnectionCandidatesPerRoom = ConnectionCandidatesPerRoom;
+		GenerationDescriptor.RoomTemplatesDataTable = RoomTemplatesDataTable;
+		GenerationDescriptor.LayoutHash = LayoutHash;
+		GenerationDescriptor.GenerationCount++;
+	}
+	else if (GenerationDescriptor.GenerationCount > 0 && GenerationDescriptor.Seed == GenerationSeed && GenerationDescriptor.LayoutHash != LayoutHash)
+	{
+		UE_LOG(DungeonGenerator, Error, TEXT("Dungeon layout of seed %d differs from the server (hash %08x, expected %08x)"), GenerationSeed, LayoutHash, GenerationDescriptor.LayoutHash);
 	}
 }
 
+void ADungeonGenerator::GenerateDungeonFromDescriptor(const FDungeonGenerationDescriptor& Descriptor)
+{
+	bUseRandomSeed = false;
+	Seed = Descriptor.Seed;
+	TileMapRows = Descriptor.TileMapRows;
+	TileMapColumns = Descriptor.TileMapColumns;
+	MinRoomSize = Descriptor.MinRoomSize;
+	MaxRoomSize = Descriptor.MaxRoomSize;
+	RoomsToGenerate = Descriptor.RoomsToGenerate;
+	MaxRandomAttemptsPerRoom = Descriptor.MaxRandomAttemptsPerRoom;
+	bUseFreeSpaceIndex = Descriptor.bUseFreeSpaceIndex;
+	CorridorStyle = Descriptor.CorridorStyle;
+	RoomConnectivity = Descriptor.RoomConnectivity;
+	ExtraConnectionsRatio = Descriptor.ExtraConnectionsRatio;
+	ConnectionCandidatesPerRoom = Descriptor.ConnectionCandidatesPerRoom;
+	RoomTemplatesDataTable = Descriptor.RoomTemplatesDataTable;
+
+	GenerateDungeonAsync();
+}
+
+void ADungeonGenerator::OnRep_GenerationDescriptor()
+{
+	if (GenerationDescriptor.GenerationCount > 0)
+	{
+		GenerateDungeonFromDescriptor(GenerationDescriptor);
+	}
+}
+
+void ADungeonGenerator::CancelDungeonGeneration()
+{
+	if (AsyncGenerationCancellationFlag.IsValid())
+	{
+		AsyncGenerationCancellationFlag->store(true);
+		AsyncGenerationCancellationFlag.Reset();
+	}
+
+	//A layout that is still waiting for its template assets would spawn on top of the next one.
+	//Handles that are done loading keep the assets of the spawned dungeon around so they stay
+	if (IsLoadingRoomTemplates())
+	{
+		ReleaseRoomTemplateAssets();
+	}
+}
+
+bool ADungeonGenerator::IsGeneratingDungeon() const
+{
+	return AsyncGenerationCancellationFlag.IsValid() || IsLoadingRoomTemplates();
+}
+
+bool ADungeonGenerator::IsLoadingRoomTemplates() const
+{
+	return RoomTemplatesLoadHandle.IsValid() && RoomTemplatesLoadHandle->IsLoadingInProgress();
+}
+
+int32 ADungeonGenerator::GetGeneratedRoomsNum() const
+{
+	return TileMatrix.GetRoomsNum();
+}
+
+int32 ADungeonGenerator::GetRoomAtLocation(const FVector& WorldLocation) const
+{
+	if (GeneratedTileSize <= 0.f)
+	{
+		return INDEX_NONE;
+	}
+
+	//Tiles are centered on multiples of the tile size
+	return TileMatrix.GetTileRoom(FMath::RoundToInt(WorldLocation.X / GeneratedTileSize), FMath::RoundToInt(WorldLocation.Y / GeneratedTileSize));
+}
+
+bool ADungeonGenerator::GetRoomBounds(int32 Room, FBox& OutBounds) const
+{
+	if (Room < 0 || Room >= TileMatrix.GetRoomsNum())
+	{
+		return false;
+	}
+
+	const FTileMatrix::FRoomLayoutInfo& RoomInfo = TileMatrix.GetRoomInfo(Room);
+	const float HalfTileSize = GeneratedTileSize / 2.f;
+	OutBounds = FBox(FVector(RoomInfo.MinRow * GeneratedTileSize - HalfTileSize, RoomInfo.MinColumn * GeneratedTileSize - HalfTileSize, 0.f),
+		FVector(RoomInfo.MaxRow * GeneratedTileSize + HalfTileSize, RoomInfo.MaxColumn * GeneratedTileSize + HalfTileSize, 0.f));
+	return true;
+}
+
+bool ADungeonGenerator::GetRoomDoorLocations(int32 Room, TArray<FVector>& OutDoorLocations) const
+{
+	OutDoorLocations.Reset();
+	if (Room < 0 || Room >= TileMatrix.GetRoomsNum())
+	{
+		return false;
+	}
+
+	TArrayView<const int32> DoorTiles = TileMatrix.GetRoomDoorTiles(Room);
+	OutDoorLocations.Reserve(DoorTiles.Num());
+	for (int32 i = 0; i < DoorTiles.Num(); i++)
+	{
+		const int32 Row = DoorTiles[i] / TileMatrix.GetColumnsNum();
+		const int32 Column = DoorTiles[i] % TileMatrix.GetColumnsNum();
+		OutDoorLocations.Add(FVector(Row * GeneratedTileSize, Column * GeneratedTileSize, 0.f));
+	}
+	return true;
+}
+
+bool ADungeonGenerator::GetConnectedRooms(int32 Room, TArray<int32>& OutRooms) const
+{
+	OutRooms.Reset();
+	if (Room < 0 || Room >= TileMatrix.GetRoomsNum())
+	{
+		return false;
+	}
+
+	OutRooms.Append(TileMatrix.GetRoomNeighbors(Room));
+	return true;
+}
+
+void ADungeonGenerator::SetSeed(int32 NewSeed)
+{
+	Seed = NewSeed;
+	bUseRandomSeed = false;
+}
+
 void ADungeonGenerator::SetNewRoomSize(int32 NewMinRoomSize, int32 NewMaxRoomSize)
 {
 	MinRoomSize = NewMinRoomSize;
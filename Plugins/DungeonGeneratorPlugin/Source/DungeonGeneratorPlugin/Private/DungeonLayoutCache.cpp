@@ -0,0 +1,135 @@
+// Copyright (c) 2022 Orfeas Eleftheriou
+
+#include "DungeonLayoutCache.h"
+#include "TileMatrix.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+DEFINE_LOG_CATEGORY(DungeonLayoutCacheLog);
+
+/* Written at the start of every layout so random files are rejected before parsing */
+static const uint32 DUNGEON_LAYOUT_MAGIC = 0x4C47444F;
+
+/**
+ * Loads a serialized layout into a tile matrix. The tile matrix is left untouched unless the whole layout loads
+ * @return false if the data isn't a valid layout of the same dimensions as the tile matrix
+ */
+static bool ReadLayout(const TArray<uint8>& LayoutData, uint32 LayoutKey, FTileMatrix& OutTileMatrix)
+{
+	FMemoryReader Reader(LayoutData);
+
+	uint32 Magic = 0;
+	uint32 StoredKey = 0;
+	Reader << Magic;
+	Reader << StoredKey;
+	if (Reader.IsError() || Magic != DUNGEON_LAYOUT_MAGIC || StoredKey != LayoutKey)
+	{
+		return false;
+	}
+
+	//A failed load stops halfway, so the layout is loaded into a copy that keeps the generation settings
+	FTileMatrix LoadedTileMatrix = OutTileMatrix;
+	LoadedTileMatrix.Serialize(Reader);
+	if (Reader.IsError() || LoadedTileMatrix.GetRowsNum() != OutTileMatrix.GetRowsNum() || LoadedTileMatrix.GetColumnsNum() != OutTileMatrix.GetColumnsNum())
+	{
+		return false;
+	}
+
+	OutTileMatrix = MoveTemp(LoadedTileMatrix);
+	return true;
+}
+
+FDungeonLayoutCache& FDungeonLayoutCache::Get()
+{
+	static FDungeonLayoutCache Instance;
+	return Instance;
+}
+
+FString FDungeonLayoutCache::GetLayoutFilePath(uint32 LayoutKey)
+{
+	return FPaths::ProjectSavedDir() / TEXT("DungeonLayouts") / FString::Printf(TEXT("%08x.layout"), LayoutKey);
+}
+
+bool FDungeonLayoutCache::Find(uint32 LayoutKey, FTileMatrix& OutTileMatrix, bool bSearchDisk)
+{
+	{
+		FScopeLock Lock(&CacheLock);
+		if (const TArray<uint8>* LayoutData = MemoryLayouts.Find(LayoutKey))
+		{
+			if (ReadLayout(*LayoutData, LayoutKey, OutTileMatrix))
+			{
+				return true;
+			}
+		}
+	}
+
+	if (!bSearchDisk)
+	{
+		return false;
+	}
+
+	TArray<uint8> LayoutData;
+	if (!FFileHelper::LoadFileToArray(LayoutData, *GetLayoutFilePath(LayoutKey), FILEREAD_Silent))
+	{
+		return false;
+	}
+
+	if (!ReadLayout(LayoutData, LayoutKey, OutTileMatrix))
+	{
+		//Written by an older version of the plugin or cut short while being written.
+		//Deleted so it isn't read again if the caller doesn't overwrite it (ie the regenerated layout gets cancelled)
+		UE_LOG(DungeonLayoutCacheLog, Log, TEXT("Deleting outdated or corrupted layout file %s"), *GetLayoutFilePath(LayoutKey));
+		IFileManager::Get().Delete(*GetLayoutFilePath(LayoutKey), false, false, true);
+		return false;
+	}
+
+	FScopeLock Lock(&CacheLock);
+	AddToMemory(LayoutKey, MoveTemp(LayoutData));
+	return true;
+}
+
+void FDungeonLayoutCache::Add(uint32 LayoutKey, FTileMatrix& InTileMatrix, bool bWriteToDisk)
+{
+	TArray<uint8> LayoutData;
+	FMemoryWriter Writer(LayoutData);
+
+	uint32 Magic = DUNGEON_LAYOUT_MAGIC;
+	Writer << Magic;
+	Writer << LayoutKey;
+	InTileMatrix.Serialize(Writer);
+
+	if (bWriteToDisk && !FFileHelper::SaveArrayToFile(LayoutData, *GetLayoutFilePath(LayoutKey)))
+	{
+		UE_LOG(DungeonLayoutCacheLog, Warning, TEXT("Couldn't write layout file %s"), *GetLayoutFilePath(LayoutKey));
+	}
+
+	FScopeLock Lock(&CacheLock);
+	AddToMemory(LayoutKey, MoveTemp(LayoutData));
+}
+
+void FDungeonLayoutCache::Empty()
+{
+	FScopeLock Lock(&CacheLock);
+	MemoryLayouts.Empty();
+	MemoryLayoutKeys.Empty();
+}
+
+void FDungeonLayoutCache::AddToMemory(uint32 LayoutKey, TArray<uint8>&& LayoutData)
+{
+	if (MemoryLayouts.Contains(LayoutKey))
+	{
+		MemoryLayoutKeys.Remove(LayoutKey);
+	}
+	MemoryLayouts.Add(LayoutKey, MoveTemp(LayoutData));
+	MemoryLayoutKeys.Add(LayoutKey);
+
+	while (MemoryLayoutKeys.Num() > FMath::Max(MaxMemoryLayouts, 0))
+	{
+		MemoryLayouts.Remove(MemoryLayoutKeys[0]);
+		MemoryLayoutKeys.RemoveAt(0);
+	}
+}
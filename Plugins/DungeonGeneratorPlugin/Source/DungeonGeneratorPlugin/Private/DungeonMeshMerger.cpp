@@ -0,0 +1,197 @@
+// Copyright (c) 2022 Orfeas Eleftheriou
+
+#include "DungeonMeshMerger.h"
+#include "KismetProceduralMeshLibrary.h"
+#include "Engine/StaticMesh.h"
+#include "StaticMeshResources.h"
+#include "Materials/MaterialInterface.h"
+#include "Async/ParallelFor.h"
+
+DEFINE_LOG_CATEGORY(DungeonMeshMergerLog);
+
+const TArray<FDungeonMeshMerger::FSourceSection>& FDungeonMeshMerger::FindOrReadSourceMesh(UStaticMesh* Mesh)
+{
+	if (const TSharedPtr<TArray<FSourceSection>>* FoundSections = SourceMeshes.Find(Mesh))
+	{
+		return **FoundSections;
+	}
+
+	TSharedPtr<TArray<FSourceSection>> Sections = MakeShared<TArray<FSourceSection>>();
+
+	const FStaticMeshRenderData* RenderData = Mesh->GetRenderData();
+	if (RenderData && RenderData->LODResources.Num() > 0)
+	{
+		const FStaticMeshLODResources& LODResources = RenderData->LODResources[0];
+		for (int32 i = 0; i < LODResources.Sections.Num(); i++)
+		{
+			FSourceSection& Section = Sections->AddDefaulted_GetRef();
+			Section.MaterialIndex = LODResources.Sections[i].MaterialIndex;
+			UKismetProceduralMeshLibrary::GetSectionFromStaticMesh(Mesh, 0, i, Section.Vertices, Section.Triangles, Section.Normals, Section.UVs, Section.Tangents);
+
+			//Keep every vertex attribute in sync with the vertices so the merge can copy them blindly
+			const int32 VerticesNum = Section.Vertices.Num();
+			if (Section.Normals.Num() != VerticesNum)
+			{
+				Section.Normals.Init(FVector::UpVector, VerticesNum);
+			}
+			if (Section.UVs.Num() != VerticesNum)
+			{
+				Section.UVs.Init(FVector2D::ZeroVector, VerticesNum);
+			}
+			if (Section.Tangents.Num() != VerticesNum)
+			{
+				Section.Tangents.Init(FProcMeshTangent(), VerticesNum);
+			}
+		}
+	}
+
+	//Meshes without CPU access return empty sections in packaged builds
+	Sections->RemoveAll([](const FSourceSection& Section)
+	{
+		return Section.Vertices.Num() == 0 || Section.Triangles.Num() == 0;
+	});
+
+	if (Sections->Num() == 0)
+	{
+		UE_LOG(DungeonMeshMergerLog, Warning, TEXT("Cannot read the geometry of %s. Verify the mesh has Allow CPU Access enabled"), *Mesh->GetName());
+	}
+
+	SourceMeshes.Add(Mesh, Sections);
+	return *Sections;
+}
+
+bool FDungeonMeshMerger::AddMeshes(int32 Group, UStaticMesh* Mesh, UMaterialInterface* OverrideMaterial, TArrayView<const FTransform> Transforms)
+{
+	if (!Mesh || Group < 0 || Transforms.Num() == 0)
+	{
+		return false;
+	}
+
+	const TArray<FSourceSection>& SourceSections = FindOrReadSourceMesh(Mesh);
+	if (SourceSections.Num() == 0)
+	{
+		return false;
+	}
+
+	if (Group >= Groups.Num())
+	{
+		Groups.SetNum(Group + 1);
+	}
+
+	FGroup& TargetGroup = Groups[Group];
+	if (TargetGroup.Copies.Num() == 0)
+	{
+		TargetGroup.Origin = Transforms[0].GetLocation();
+	}
+
+	FMeshCopies& Copies = TargetGroup.Copies.AddDefaulted_GetRef();
+	Copies.SourceSections = &SourceSections;
+	Copies.Transforms.Append(Transforms.GetData(), Transforms.Num());
+
+	//Same as the spawned meshes: the override only replaces the 1st material
+	Copies.SectionMaterials.Reserve(SourceSections.Num());
+	for (int32 i = 0; i < SourceSections.Num(); i++)
+	{
+		const int32 MaterialIndex = SourceSections[i].MaterialIndex;
+		Copies.SectionMaterials.Add((MaterialIndex == 0 && OverrideMaterial) ? OverrideMaterial : Mesh->GetMaterial(MaterialIndex));
+	}
+
+	return true;
+}
+
+void FDungeonMeshMerger::Build()
+{
+	//Each group only writes its own sections
+	ParallelFor(Groups.Num(), [this](int32 GroupIndex)
+	{
+		BuildGroup(Groups[GroupIndex]);
+	});
+}
+
+void FDungeonMeshMerger::BuildGroup(FGroup& Group)
+{
+	Group.Sections.Reset();
+
+	auto FindOrAddSection = [&Group](UMaterialInterface* Material)
+	{
+		//A group rarely uses more than a handful of materials
+		for (int32 i = 0; i < Group.Sections.Num(); i++)
+		{
+			if (Group.Sections[i].Material == Material)
+			{
+				return i;
+			}
+		}
+		FMergedSection& NewSection = Group.Sections.AddDefaulted_GetRef();
+		NewSection.Material = Material;
+		return Group.Sections.Num() - 1;
+	};
+
+	//Count the geometry of each merged section first so every buffer is allocated once
+	TArray<int32> VerticesNum;
+	TArray<int32> TrianglesNum;
+	for (int32 i = 0; i < Group.Copies.Num(); i++)
+	{
+		const FMeshCopies& Copies = Group.Copies[i];
+		for (int32 j = 0; j < Copies.SourceSections->Num(); j++)
+		{
+			const int32 SectionIndex = FindOrAddSection(Copies.SectionMaterials[j]);
+			VerticesNum.SetNumZeroed(Group.Sections.Num());
+			TrianglesNum.SetNumZeroed(Group.Sections.Num());
+			VerticesNum[SectionIndex] += (*Copies.SourceSections)[j].Vertices.Num() * Copies.Transforms.Num();
+			TrianglesNum[SectionIndex] += (*Copies.SourceSections)[j].Triangles.Num() * Copies.Transforms.Num();
+		}
+	}
+
+	for (int32 i = 0; i < Group.Sections.Num(); i++)
+	{
+		FMergedSection& Section = Group.Sections[i];
+		Section.Vertices.Reserve(VerticesNum[i]);
+		Section.Normals.Reserve(VerticesNum[i]);
+		Section.UVs.Reserve(VerticesNum[i]);
+		Section.Tangents.Reserve(VerticesNum[i]);
+		Section.Triangles.Reserve(TrianglesNum[i]);
+	}
+
+	for (int32 i = 0; i < Group.Copies.Num(); i++)
+	{
+		const FMeshCopies& Copies = Group.Copies[i];
+		for (int32 j = 0; j < Copies.SourceSections->Num(); j++)
+		{
+			const FSourceSection& Source = (*Copies.SourceSections)[j];
+			FMergedSection& Target = Group.Sections[FindOrAddSection(Copies.SectionMaterials[j])];
+
+			for (int32 k = 0; k < Copies.Transforms.Num(); k++)
+			{
+				const FTransform& Transform = Copies.Transforms[k];
+				const FVector Scale = Transform.GetScale3D();
+				const FQuat Rotation = Transform.GetRotation();
+
+				//Mirrored copies flip the winding of their triangles
+				const bool bIsMirrored = Scale.X * Scale.Y * Scale.Z < 0.f;
+				const int32 FirstVertex = Target.Vertices.Num();
+
+				for (int32 Vertex = 0; Vertex < Source.Vertices.Num(); Vertex++)
+				{
+					Target.Vertices.Add(Transform.TransformPosition(Source.Vertices[Vertex]) - Group.Origin);
+
+					//Normals follow the inverse scale so they stay perpendicular to stretched surfaces
+					Target.Normals.Add(Rotation.RotateVector(Source.Normals[Vertex] / Scale).GetSafeNormal());
+					Target.UVs.Add(Source.UVs[Vertex]);
+
+					FProcMeshTangent Tangent = Source.Tangents[Vertex];
+					Tangent.TangentX = Transform.TransformVector(Tangent.TangentX).GetSafeNormal();
+					Tangent.bFlipTangentY = Tangent.bFlipTangentY != bIsMirrored;
+					Target.Tangents.Add(Tangent);
+				}
+
+				for (int32 Index = 0; Index + 2 < Source.Triangles.Num(); Index += 3)
+				{
+					Target.Triangles.Add(FirstVertex + Source.Triangles[Index]);
+					Target.Triangles.Add(FirstVertex + Source.Triangles[bIsMirrored ? Index + 2 : Index + 1]);
+					Target.Triangles.Add(FirstVertex + Source.Triangles[bIsMirrored ? Index + 1 : Index + 2]);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,141 @@
+// Copyright (c) 2022 Orfeas Eleftheriou
+
+#include "TileBitCounts.h"
+#include "TileBitGrid.h"
+
+FTileBitCounts::FTileBitCounts()
+{
+	RowsNum = 0;
+	WordsPerRow = 0;
+	TotalCount = 0;
+}
+
+void FTileBitCounts::Init(const FTileBitGrid& Grid)
+{
+	RowsNum = Grid.GetRowsNum();
+	WordsPerRow = Grid.GetWordsPerRow();
+
+	WordPrefixes.Empty(RowsNum * (WordsPerRow + 1));
+	WordPrefixes.AddZeroed(RowsNum * (WordsPerRow + 1));
+	RowTree.Empty(RowsNum + 1);
+	RowTree.AddZeroed(RowsNum + 1);
+	TotalCount = 0;
+
+	for (int32 i = 0; i < RowsNum; i++)
+	{
+		UpdateRow(Grid, i, 0);
+	}
+}
+
+void FTileBitCounts::UpdateRow(const FTileBitGrid& Grid, int32 Row, int32 FirstColumn)
+{
+	checkSlow(Grid.GetRowsNum() == RowsNum && Grid.GetWordsPerRow() == WordsPerRow);
+	checkSlow(Row >= 0 && Row < RowsNum);
+
+	const uint64* RowData = Grid.GetRowData(Row);
+	int32* RowPrefixes = WordPrefixes.GetData() + Row * (WordsPerRow + 1);
+
+	//Words before the first changed one still hold the same bits
+	const int32 FirstWord = FMath::Max(FirstColumn, 0) / FTileBitGrid::BitsPerWord;
+	const int32 OldRowCount = RowPrefixes[WordsPerRow];
+	for (int32 i = FirstWord; i < WordsPerRow; i++)
+	{
+		RowPrefixes[i + 1] = RowPrefixes[i] + FMath::CountBits(RowData[i]);
+	}
+
+	const int32 Delta = RowPrefixes[WordsPerRow] - OldRowCount;
+	if (Delta != 0)
+	{
+		TotalCount += Delta;
+		for (int32 i = Row + 1; i <= RowsNum; i += i & -i)
+		{
+			RowTree[i] += Delta;
+		}
+	}
+}
+
+void FTileBitCounts::FindNthSetBit(const FTileBitGrid& Grid, int32 Index, int32& OutRow, int32& OutColumn) const
+{
+	checkSlow(Index >= 0 && Index < TotalCount);
+
+	//Descend the tree to the last row whose preceding rows hold no more than Index bits
+	int32 Row = 0;
+	int32 Remaining = Index;
+	for (int32 Step = 1 << FMath::FloorLog2(RowsNum); Step > 0; Step >>= 1)
+	{
+		if (Row + Step <= RowsNum && RowTree[Row + Step] <= Remaining)
+		{
+			Row += Step;
+			Remaining -= RowTree[Row];
+		}
+	}
+
+	//Last word whose preceding words hold no more than Remaining bits
+	const int32* RowPrefixes = WordPrefixes.GetData() + Row * (WordsPerRow + 1);
+	int32 FirstWord = 0;
+	int32 LastWord = WordsPerRow - 1;
+	while (FirstWord < LastWord)
+	{
+		const int32 MiddleWord = (FirstWord + LastWord + 1) / 2;
+		if (RowPrefixes[MiddleWord] <= Remaining)
+		{
+			FirstWord = MiddleWord;
+		}
+		else
+		{
+			LastWord = MiddleWord - 1;
+		}
+	}
+	Remaining -= RowPrefixes[FirstWord];
+
+	//Drop the lower set bits of the word
+	uint64 Word = Grid.GetWord(Row, FirstWord);
+	for (int32 i = 0; i < Remaining; i++)
+	{
+		Word &= Word - 1;
+	}
+
+	OutRow = Row;
+	OutColumn = FirstWord * FTileBitGrid::BitsPerWord + static_cast<int32>(FMath::CountTrailingZeros64(Word));
+}
+
+int32 FTileBitCounts::CountBefore(const FTileBitGrid& Grid, int32 Row, int32 Column) const
+{
+	const int32 Word = Column / FTileBitGrid::BitsPerWord;
+	const int32 Bit = Column % FTileBitGrid::BitsPerWord;
+
+	const int32 Count = WordPrefixes[Row * (WordsPerRow + 1) + Word];
+	if (Bit == 0)
+	{
+		return Count;
+	}
+	return Count + FMath::CountBits(Grid.GetWord(Row, Word) & ((uint64(1) << Bit) - 1));
+}
+
+int32 FTileBitCounts::CountRowSpan(const FTileBitGrid& Grid, int32 Row, int32 FirstColumn, int32 LastColumn) const
+{
+	checkSlow(Grid.IsValidIndex(Row, FirstColumn) && Grid.IsValidIndex(Row, LastColumn) && FirstColumn <= LastColumn);
+	return CountBefore(Grid, Row, LastColumn + 1) - CountBefore(Grid, Row, FirstColumn);
+}
+
+int32 FTileBitCounts::CountRect(const FTileBitGrid& Grid, int32 MinRow, int32 MinColumn, int32 MaxRow, int32 MaxColumn) const
+{
+	int32 Count = 0;
+	for (int32 i = MinRow; i <= MaxRow; i++)
+	{
+		Count += CountRowSpan(Grid, i, MinColumn, MaxColumn);
+	}
+	return Count;
+}
+
+bool FTileBitCounts::IsRectEmpty(const FTileBitGrid& Grid, int32 MinRow, int32 MinColumn, int32 MaxRow, int32 MaxColumn) const
+{
+	for (int32 i = MinRow; i <= MaxRow; i++)
+	{
+		if (CountRowSpan(Grid, i, MinColumn, MaxColumn) != 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,267 @@
+// Copyright (c) 2022 Orfeas Eleftheriou
+
+#include "TileBitGrid.h"
+
+FTileBitGrid::FTileBitGrid()
+{
+	RowsNum = 0;
+	ColumnsNum = 0;
+	WordsPerRow = 0;
+}
+
+FTileBitGrid::FTileBitGrid(int32 Rows, int32 Columns)
+{
+	Init(Rows, Columns);
+}
+
+void FTileBitGrid::Init(int32 Rows, int32 Columns)
+{
+	RowsNum = FMath::Max(Rows, 0);
+	ColumnsNum = FMath::Max(Columns, 0);
+	WordsPerRow = FMath::DivideAndRoundUp(ColumnsNum, BitsPerWord);
+
+	Words.Empty(RowsNum * WordsPerRow);
+	Words.AddZeroed(RowsNum * WordsPerRow);
+}
+
+void FTileBitGrid::Reset()
+{
+	FMemory::Memzero(Words.GetData(), Words.Num() * sizeof(uint64));
+}
+
+bool FTileBitGrid::IsRowSpanEmpty(int32 Row, int32 FirstColumn, int32 LastColumn) const
+{
+	checkSlow(IsValidIndex(Row, FirstColumn) && IsValidIndex(Row, LastColumn) && FirstColumn <= LastColumn);
+
+	const uint64* RowData = GetRowData(Row);
+	const int32 FirstWord = FirstColumn / BitsPerWord;
+	const int32 LastWord = LastColumn / BitsPerWord;
+
+	if (FirstWord == LastWord)
+	{
+		return (RowData[FirstWord] & SpanMask(FirstColumn % BitsPerWord, LastColumn % BitsPerWord)) == 0;
+	}
+
+	if (RowData[FirstWord] & SpanMask(FirstColumn % BitsPerWord, BitsPerWord - 1))
+	{
+		return false;
+	}
+	for (int32 i = FirstWord + 1; i < LastWord; i++)
+	{
+		if (RowData[i])
+		{
+			return false;
+		}
+	}
+	return (RowData[LastWord] & SpanMask(0, LastColumn % BitsPerWord)) == 0;
+}
+
+bool FTileBitGrid::IsRowSpanFull(int32 Row, int32 FirstColumn, int32 LastColumn) const
+{
+	checkSlow(IsValidIndex(Row, FirstColumn) && IsValidIndex(Row, LastColumn) && FirstColumn <= LastColumn);
+
+	const uint64* RowData = GetRowData(Row);
+	const int32 FirstWord = FirstColumn / BitsPerWord;
+	const int32 LastWord = LastColumn / BitsPerWord;
+
+	if (FirstWord == LastWord)
+	{
+		const uint64 Mask = SpanMask(FirstColumn % BitsPerWord, LastColumn % BitsPerWord);
+		return (RowData[FirstWord] & Mask) == Mask;
+	}
+
+	const uint64 FirstMask = SpanMask(FirstColumn % BitsPerWord, BitsPerWord - 1);
+	if ((RowData[FirstWord] & FirstMask) != FirstMask)
+	{
+		return false;
+	}
+	for (int32 i = FirstWord + 1; i < LastWord; i++)
+	{
+		if (RowData[i] != ~uint64(0))
+		{
+			return false;
+		}
+	}
+	const uint64 LastMask = SpanMask(0, LastColumn % BitsPerWord);
+	return (RowData[LastWord] & LastMask) == LastMask;
+}
+
+void FTileBitGrid::SetRowSpan(int32 Row, int32 FirstColumn, int32 LastColumn)
+{
+	checkSlow(IsValidIndex(Row, FirstColumn) && IsValidIndex(Row, LastColumn) && FirstColumn <= LastColumn);
+
+	uint64* RowData = Words.GetData() + Row * WordsPerRow;
+	const int32 FirstWord = FirstColumn / BitsPerWord;
+	const int32 LastWord = LastColumn / BitsPerWord;
+
+	if (FirstWord == LastWord)
+	{
+		RowData[FirstWord] |= SpanMask(FirstColumn % BitsPerWord, LastColumn % BitsPerWord);
+		return;
+	}
+
+	RowData[FirstWord] |= SpanMask(FirstColumn % BitsPerWord, BitsPerWord - 1);
+	for (int32 i = FirstWord + 1; i < LastWord; i++)
+	{
+		RowData[i] = ~uint64(0);
+	}
+	RowData[LastWord] |= SpanMask(0, LastColumn % BitsPerWord);
+}
+
+void FTileBitGrid::ClearRowSpan(int32 Row, int32 FirstColumn, int32 LastColumn)
+{
+	checkSlow(IsValidIndex(Row, FirstColumn) && IsValidIndex(Row, LastColumn) && FirstColumn <= LastColumn);
+
+	uint64* RowData = Words.GetData() + Row * WordsPerRow;
+	const int32 FirstWord = FirstColumn / BitsPerWord;
+	const int32 LastWord = LastColumn / BitsPerWord;
+
+	if (FirstWord == LastWord)
+	{
+		RowData[FirstWord] &= ~SpanMask(FirstColumn % BitsPerWord, LastColumn % BitsPerWord);
+		return;
+	}
+
+	RowData[FirstWord] &= ~SpanMask(FirstColumn % BitsPerWord, BitsPerWord - 1);
+	for (int32 i = FirstWord + 1; i < LastWord; i++)
+	{
+		RowData[i] = 0;
+	}
+	RowData[LastWord] &= ~SpanMask(0, LastColumn % BitsPerWord);
+}
+
+bool FTileBitGrid::IsRectEmpty(int32 MinRow, int32 MinColumn, int32 MaxRow, int32 MaxColumn) const
+{
+	checkSlow(MinRow <= MaxRow);
+
+	for (int32 i = MinRow; i <= MaxRow; i++)
+	{
+		if (!IsRowSpanEmpty(i, MinColumn, MaxColumn))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void FTileBitGrid::SetRect(int32 MinRow, int32 MinColumn, int32 MaxRow, int32 MaxColumn)
+{
+	checkSlow(MinRow <= MaxRow);
+
+	for (int32 i = MinRow; i <= MaxRow; i++)
+	{
+		SetRowSpan(i, MinColumn, MaxColumn);
+	}
+}
+
+void FTileBitGrid::Serialize(FArchive& Ar)
+{
+	int32 Rows = RowsNum;
+	int32 Columns = ColumnsNum;
+	Ar << Rows;
+	Ar << Columns;
+
+	if (Ar.IsLoading())
+	{
+		//Reject anything that doesn't fit an int32 tile index before allocating
+		if (Ar.IsError() || Rows < 0 || Columns < 0 || int64(Rows) * Columns > MAX_int32)
+		{
+			Ar.SetError();
+			Init(0, 0);
+			return;
+		}
+		Init(Rows, Columns);
+	}
+
+	const int32 ExpectedWordsNum = Words.Num();
+	Ar << Words;
+
+	if (Ar.IsLoading())
+	{
+		if (Ar.IsError() || Words.Num() != ExpectedWordsNum)
+		{
+			Ar.SetError();
+			Init(0, 0);
+			return;
+		}
+
+		//Bits past the last column must stay cleared
+		if (ColumnsNum % BitsPerWord != 0)
+		{
+			const uint64 LastWordMask = SpanMask(0, ColumnsNum % BitsPerWord - 1);
+			for (int32 i = 0; i < RowsNum; i++)
+			{
+				Words[i * WordsPerRow + WordsPerRow - 1] &= LastWordMask;
+			}
+		}
+	}
+}
+
+void FTileBitGrid::FindEmptySquares(int32 Size, FTileBitGrid& OutCorners) const
+{
+	OutCorners.Init(RowsNum, ColumnsNum);
+	if (Size <= 0 || Size > RowsNum || Size > ColumnsNum)
+	{
+		return;
+	}
+
+	const uint64 LastWordMask = (ColumnsNum % BitsPerWord != 0) ? SpanMask(0, ColumnsNum % BitsPerWord - 1) : ~uint64(0);
+
+	//Bit j of a row is set when the columns [j, j + Size) of the row are cleared
+	TArray<uint64> EmptyRuns;
+	EmptyRuns.SetNumUninitialized(Words.Num());
+	TArray<uint64> EmptyTiles;
+	EmptyTiles.SetNumUninitialized(WordsPerRow);
+
+	for (int32 i = 0; i < RowsNum; i++)
+	{
+		const uint64* RowData = GetRowData(i);
+		for (int32 j = 0; j < WordsPerRow; j++)
+		{
+			EmptyTiles[j] = ~RowData[j];
+		}
+		//Bits past the last column aren't tiles
+		EmptyTiles[WordsPerRow - 1] &= LastWordMask;
+
+		uint64* RowRuns = EmptyRuns.GetData() + i * WordsPerRow;
+		FMemory::Memcpy(RowRuns, EmptyTiles.GetData(), WordsPerRow * sizeof(uint64));
+
+		//Shift the empty tiles of the row towards column 0, one column at a time
+		for (int32 Shift = 1; Shift < Size; Shift++)
+		{
+			const int32 WordShift = Shift / BitsPerWord;
+			const int32 BitShift = Shift % BitsPerWord;
+			for (int32 j = 0; j < WordsPerRow; j++)
+			{
+				const uint64 Lower = (j + WordShift < WordsPerRow) ? EmptyTiles[j + WordShift] : 0;
+				const uint64 Upper = (j + WordShift + 1 < WordsPerRow) ? EmptyTiles[j + WordShift + 1] : 0;
+				RowRuns[j] &= (BitShift == 0) ? Lower : ((Lower >> BitShift) | (Upper << (BitsPerWord - BitShift)));
+			}
+		}
+	}
+
+	//A square starts where the runs of Size consecutive rows overlap
+	for (int32 i = 0; i + Size <= RowsNum; i++)
+	{
+		uint64* Corners = OutCorners.Words.GetData() + i * WordsPerRow;
+		FMemory::Memcpy(Corners, EmptyRuns.GetData() + i * WordsPerRow, WordsPerRow * sizeof(uint64));
+		for (int32 Row = i + 1; Row < i + Size; Row++)
+		{
+			const uint64* RowRuns = EmptyRuns.GetData() + Row * WordsPerRow;
+			for (int32 j = 0; j < WordsPerRow; j++)
+			{
+				Corners[j] &= RowRuns[j];
+			}
+		}
+	}
+}
+
+int32 FTileBitGrid::CountSetBits() const
+{
+	int32 Count = 0;
+	for (int32 i = 0; i < Words.Num(); i++)
+	{
+		Count += FMath::CountBits(Words[i]);
+	}
+	return Count;
+}
@@ -1,6 +1,7 @@
 // Copyright (c) 2022 Orfeas Eleftheriou
 
 #include "TileMatrix.h"
+#include "Async/ParallelFor.h"
 
 DEFINE_LOG_CATEGORY(TileMatrixLog);
 
@@ -9,511 +10,1904 @@ int32 FTileMatrix::ManhattanDistance(const Tile& A, const Tile& B)
 	return FMath::Abs(A.Key - B.Key) + FMath::Abs(A.Value - B.Value);
 }
 
-void FTileMatrix::StoreGeneratedRoom(const FRoomTileCollection& InRoom)
+/**
+ * Packs an ordered pair of indices so pairs can be sorted & deduplicated as plain integers
+ */
+static inline int64 PackIndexPair(int32 A, int32 B)
+{
+	return (int64(A) << 32) | uint32(B);
+}
+
+static inline int32 GetPackedFirst(int64 Pair)
+{
+	return static_cast<int32>(Pair >> 32);
+}
+
+static inline int32 GetPackedSecond(int64 Pair)
+{
+	return static_cast<int32>(Pair & 0xFFFFFFFF);
+}
+
+void FTileMatrix::StoreGeneratedRoom(const FRoomRect& InRoom)
 {
 	GeneratedRooms.Add(InRoom);
-	if (GeneratedRooms.Num() > 1)
+	if (RoomConnectivity == ERoomConnectivity::Chain && GeneratedRooms.Num() > 1)
+	{
+		ConnectRooms(InRoom, GeneratedRooms.Get(GeneratedRooms.Num() - 2));
+	}
+}
+
+/**
+ * Picks the closest pair of values between two ranges [MinA, MaxA] and [MinB, MaxB].
+ * Overlapping ranges meet in the middle of the overlap so corridors are centered between the rooms
+ */
+static void FindClosestAxisValues(int32 MinA, int32 MaxA, int32 MinB, int32 MaxB, int32& OutA, int32& OutB)
+{
+	if (MaxA < MinB)
+	{
+		OutA = MaxA;
+		OutB = MinB;
+	}
+	else if (MaxB < MinA)
+	{
+		OutA = MinA;
+		OutB = MaxB;
+	}
+	else
+	{
+		OutA = (FMath::Max(MinA, MinB) + FMath::Min(MaxA, MaxB)) / 2;
+		OutB = OutA;
+	}
+}
+
+FTileMatrix::FTileConnection FTileMatrix::FindClosestTilesOfRooms(const FRoomRect& From, const FRoomRect& To)
+{
+	FTileConnection Connection;
+	FindClosestAxisValues(From.MinRow, From.MaxRow, To.MinRow, To.MaxRow, Connection.Start.Key, Connection.End.Key);
+	FindClosestAxisValues(From.MinColumn, From.MaxColumn, To.MinColumn, To.MaxColumn, Connection.Start.Value, Connection.End.Value);
+	return Connection;
+}
+
+void FTileMatrix::ConnectRooms(const FRoomRect& A, const FRoomRect& B)
+{
+	if (A.IsEmpty() || B.IsEmpty())
+	{
+		return;
+	}
+
+	//Start the connection from the room with more tiles
+	const FRoomRect& From = (B.GetTilesNum() > A.GetTilesNum()) ? B : A;
+	const FRoomRect& To = (B.GetTilesNum() > A.GetTilesNum()) ? A : B;
+
+	//Find shortest route
+	FTileConnection Path = FindClosestTilesOfRooms(From, To);
+
+	//Border portals aren't rooms so their connections aren't recorded
+	const int32 RoomA = GetTileRoom(Path.Start.Key, Path.Start.Value);
+	const int32 RoomB = GetTileRoom(Path.End.Key, Path.End.Value);
+	if (RoomA != INDEX_NONE && RoomB != INDEX_NONE && RoomA != RoomB)
+	{
+		RoomConnections.Add(PackIndexPair(FMath::Min(RoomA, RoomB), FMath::Max(RoomA, RoomB)));
+	}
+
+	if (CorridorStyle == ECorridorStyle::Routed)
+	{
+		if (RouteCorridor(Path.Start, Path.End))
+		{
+			return;
+		}
+		UE_LOG(TileMatrixLog, Verbose, TEXT("Couldn't route a corridor between %s and %s. Falling back to a greedy corridor"), *TileToString(Path.Start), *TileToString(Path.End));
+	}
+	CarveCorridor(Path.Start, Path.End, (CorridorStyle == ECorridorStyle::Routed) ? ECorridorStyle::Greedy : CorridorStyle);
+}
+
+void FTileMatrix::AddBorderPortal(int32 Row, int32 Column)
+{
+	const Tile BorderTile(Row, Column);
+	const bool bIsOnEdge = BorderTile.Key == 0 || BorderTile.Value == 0 || BorderTile.Key == RowsNum - 1 || BorderTile.Value == ColumnsNum - 1;
+	if (IsTileInMap(BorderTile) && bIsOnEdge)
+	{
+		BorderPortals.AddUnique(BorderTile);
+	}
+}
+
+void FTileMatrix::ConnectBorderPortals()
+{
+	for (int32 i = 0; i < BorderPortals.Num(); i++)
 	{
-		ConnectRooms(InRoom, GeneratedRooms.Last(1));
+		OccupyCorridorTile(BorderPortals[i].Key, BorderPortals[i].Value);
 	}
+
+	for (int32 i = 0; i < BorderPortals.Num() && !IsCancelled(); i++)
+	{
+		const FRoomRect PortalRoom(BorderPortals[i]);
+
+		if (GeneratedRooms.Num() == 0)
+		{
+			if (i > 0)
+			{
+				ConnectRooms(FRoomRect(BorderPortals[0]), PortalRoom);
+			}
+			continue;
+		}
+
+		//Closest room based on the distance between the portal and the bounds of each room
+		int32 ClosestRoom = 0;
+		int32 ClosestDistance = MAX_int32;
+		for (int32 j = 0; j < GeneratedRooms.Num(); j++)
+		{
+			const FRoomRect Room = GeneratedRooms.Get(j);
+			const Tile ClosestTile(FMath::Clamp(BorderPortals[i].Key, Room.MinRow, Room.MaxRow), FMath::Clamp(BorderPortals[i].Value, Room.MinColumn, Room.MaxColumn));
+			const int32 Distance = ManhattanDistance(ClosestTile, BorderPortals[i]);
+			if (Distance < ClosestDistance)
+			{
+				ClosestDistance = Distance;
+				ClosestRoom = j;
+			}
+		}
+		ConnectRooms(GeneratedRooms.Get(ClosestRoom), PortalRoom);
+	}
+
+	RebuildLayoutGraph();
 }
 
-void FTileMatrix::ConnectRooms(const FRoomTileCollection& A, const FRoomTileCollection& B)
+void FTileMatrix::CarveCorridor(const Tile& Start, const Tile& End, ECorridorStyle Style)
 {
-	TArray<Tile> OccupiedTilesA = A.OccupiedTiles;
-	TArray<Tile> OccupiedTilesB = B.OccupiedTiles;
+	//If the tiles are next to each other the rooms are already connected
+	if (ManhattanDistance(Start, End) <= 1)
+	{
+		return;
+	}
 
-	TArray<FTileConnection> TileConnections;
+	const int32 RowDelta = End.Key - Start.Key;
+	const int32 ColumnDelta = End.Value - Start.Value;
+	const bool bRowsFirst = FMath::Abs(RowDelta) >= FMath::Abs(ColumnDelta);
 
-	//Connect all tiles from room with more tiles to all tiles of room with less tiles
-	if (OccupiedTilesB.Num() > OccupiedTilesA.Num())
+	//Up to two bends between Start and End
+	Tile Waypoints[4];
+	int32 WaypointsNum = 0;
+	Waypoints[WaypointsNum++] = Start;
+
+	switch (Style)
 	{
-		for (int32 i = 0; i < OccupiedTilesB.Num(); i++)
+		case ECorridorStyle::Greedy:
+		case ECorridorStyle::Routed:
+		{
+			//The greedy walk picks the first nearby tile that gets closer, checking up, right, left and down in that order.
+			//So it climbs up to the target row first, then moves sideways and only moves down at the end
+			Waypoints[WaypointsNum++] = (RowDelta < 0) ? Tile(End.Key, Start.Value) : Tile(Start.Key, End.Value);
+			break;
+		}
+		case ECorridorStyle::LShaped:
+		{
+			Waypoints[WaypointsNum++] = bRowsFirst ? Tile(End.Key, Start.Value) : Tile(Start.Key, End.Value);
+			break;
+		}
+		case ECorridorStyle::ZShaped:
 		{
-			for (int32 j = 0; j < OccupiedTilesA.Num(); j++)
+			if (bRowsFirst)
+			{
+				const int32 MiddleRow = Start.Key + RowDelta / 2;
+				Waypoints[WaypointsNum++] = Tile(MiddleRow, Start.Value);
+				Waypoints[WaypointsNum++] = Tile(MiddleRow, End.Value);
+			}
+			else
 			{
-				TileConnections.Add(FTileConnection(OccupiedTilesB[i], OccupiedTilesA[j]));
+				const int32 MiddleColumn = Start.Value + ColumnDelta / 2;
+				Waypoints[WaypointsNum++] = Tile(Start.Key, MiddleColumn);
+				Waypoints[WaypointsNum++] = Tile(End.Key, MiddleColumn);
 			}
+			break;
+		}
+	}
+
+	Waypoints[WaypointsNum++] = End;
+
+	for (int32 i = 0; i + 1 < WaypointsNum; i++)
+	{
+		//The end tile belongs to the target room so the leg that reaches it stops right before it
+		CarveCorridorLeg(Waypoints[i], Waypoints[i + 1], Waypoints[i + 1] != End);
+	}
+}
+
+bool FTileMatrix::RouteCorridor(const Tile& Start, const Tile& End)
+{
+	if (ManhattanDistance(Start, End) <= 1)
+	{
+		return true;
+	}
+
+	CorridorRouter.Init(RowsNum, ColumnsNum);
+	if (!CorridorRouter.FindPath(Start.Key * ColumnsNum + Start.Value, End.Key * ColumnsNum + End.Value, TileCosts, RoutingCosts.HeuristicCost, RoutedPath))
+	{
+		return false;
+	}
+
+	//First and last tiles belong to the connected rooms
+	for (int32 i = 1; i + 1 < RoutedPath.Num(); i++)
+	{
+		OccupyCorridorTile(RoutedPath[i] / ColumnsNum, RoutedPath[i] % ColumnsNum);
+	}
+	return true;
+}
+
+void FTileMatrix::CarveCorridorLeg(const Tile& From, const Tile& To, bool bIncludeTo)
+{
+	checkSlow(From.Key == To.Key || From.Value == To.Value);
+
+	if (From.Key == To.Key)
+	{
+		//Sideways leg. Written as a single span of the row
+		if (To.Value > From.Value)
+		{
+			OccupyCorridorRowSpan(From.Key, From.Value + 1, bIncludeTo ? To.Value : To.Value - 1);
+		}
+		else
+		{
+			OccupyCorridorRowSpan(From.Key, bIncludeTo ? To.Value : To.Value + 1, From.Value - 1);
 		}
 	}
 	else
 	{
-		for (int32 i = 0; i < OccupiedTilesA.Num(); i++)
+		if (To.Key > From.Key)
+		{
+			OccupyCorridorColumnSpan(From.Value, From.Key + 1, bIncludeTo ? To.Key : To.Key - 1);
+		}
+		else
+		{
+			OccupyCorridorColumnSpan(From.Value, bIncludeTo ? To.Key : To.Key + 1, From.Key - 1);
+		}
+	}
+}
+
+/**
+ * Candidate connection between two generated rooms
+ */
+struct FRoomConnectionCandidate
+{
+	int32 RoomA;
+	int32 RoomB;
+
+	/* Squared distance between the (doubled) room centers */
+	int64 Length;
+
+	FRoomConnectionCandidate() : RoomA(INDEX_NONE), RoomB(INDEX_NONE), Length(0) {}
+
+	FRoomConnectionCandidate(int32 A, int32 B, int64 InLength) : RoomA(FMath::Min(A, B)), RoomB(FMath::Max(A, B)), Length(InLength) {}
+
+	inline bool operator<(const FRoomConnectionCandidate& Other) const
+	{
+		if (Length != Other.Length)
+		{
+			return Length < Other.Length;
+		}
+		return RoomA != Other.RoomA ? RoomA < Other.RoomA : RoomB < Other.RoomB;
+	}
+};
+
+/**
+ * Buckets room centers in a uniform grid (about one room per cell) to find the nearest rooms
+ * of a room by visiting rings of cells around it
+ */
+class FRoomCenterGrid
+{
+public:
+
+	/**
+	 * @param Centers - doubled room centers (ie MinRow + MaxRow, MinColumn + MaxColumn) so they stay integers
+	 * @param Rows - the rows of the tile map
+	 * @param Columns - the columns of the tile map
+	 */
+	FRoomCenterGrid(const TArray<TTuple<int32, int32>>& Centers, int32 Rows, int32 Columns) : RoomCenters(Centers)
+	{
+		//Doubled coordinates
+		CellSize = FMath::Max(2, 2 * FMath::FloorToInt(FMath::Sqrt(double(Rows) * Columns / FMath::Max(Centers.Num(), 1))));
+		CellRows = FMath::Max(2 * Rows / CellSize + 1, 1);
+		CellColumns = FMath::Max(2 * Columns / CellSize + 1, 1);
+
+		//Counting sort of the rooms into the cells
+		CellStart.SetNumZeroed(CellRows * CellColumns + 1);
+		for (int32 i = 0; i < Centers.Num(); i++)
+		{
+			CellStart[GetCell(i) + 1]++;
+		}
+		for (int32 i = 0; i < CellRows * CellColumns; i++)
+		{
+			CellStart[i + 1] += CellStart[i];
+		}
+		TArray<int32> CellFill = CellStart;
+		CellRooms.SetNumUninitialized(Centers.Num());
+		for (int32 i = 0; i < Centers.Num(); i++)
+		{
+			CellRooms[CellFill[GetCell(i)]++] = i;
+		}
+	}
+
+	/**
+	 * Finds up to Count nearest rooms of a room that pass the filter
+	 * @param RoomIndex - the room to search around
+	 * @param Count - max rooms to find
+	 * @param Filter - returns true for the rooms that can be accepted
+	 * @param OutNearest - the accepted rooms, sorted by distance
+	 */
+	void FindNearestRooms(int32 RoomIndex, int32 Count, TFunctionRef<bool(int32)> Filter, TArray<FRoomConnectionCandidate>& OutNearest) const
+	{
+		OutNearest.Reset();
+
+		const int32 CenterRow = FMath::Clamp(RoomCenters[RoomIndex].Key / CellSize, 0, CellRows - 1);
+		const int32 CenterColumn = FMath::Clamp(RoomCenters[RoomIndex].Value / CellSize, 0, CellColumns - 1);
+		const int32 MaxRing = FMath::Max(CellRows, CellColumns);
+
+		for (int32 Ring = 0; Ring <= MaxRing; Ring++)
+		{
+			//Every room outside of this ring is at least (Ring * CellSize) away
+			if (OutNearest.Num() == Count && FMath::Square(int64(Ring - 1) * CellSize) > OutNearest.Last().Length)
+			{
+				break;
+			}
+
+			for (int32 Row = CenterRow - Ring; Row <= CenterRow + Ring; Row++)
+			{
+				if (Row < 0 || Row >= CellRows)
+				{
+					continue;
+				}
+
+				//Only the border of the ring. Inner cells have been visited already
+				const bool bBorderRow = (Row == CenterRow - Ring || Row == CenterRow + Ring);
+				const int32 ColumnStep = (bBorderRow || Ring == 0) ? 1 : 2 * Ring;
+				for (int32 Column = CenterColumn - Ring; Column <= CenterColumn + Ring; Column += ColumnStep)
+				{
+					if (Column < 0 || Column >= CellColumns)
+					{
+						continue;
+					}
+
+					const int32 Cell = Row * CellColumns + Column;
+					for (int32 i = CellStart[Cell]; i < CellStart[Cell + 1]; i++)
+					{
+						const int32 OtherRoom = CellRooms[i];
+						if (OtherRoom != RoomIndex && Filter(OtherRoom))
+						{
+							AddNearestRoom(FRoomConnectionCandidate(RoomIndex, OtherRoom, GetDistance(RoomIndex, OtherRoom)), Count, OutNearest);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	 * Finds connections that join groups of rooms (ie the pieces of a disconnected candidate graph) into a single piece.
+	 * Rooms of a cell connect to the group of its first room. Then a breadth-first flood lets every cell get claimed by its
+	 * closest cell with rooms, and every pair of neighbor cells that ends up in different groups yields a connection between
+	 * the closest rooms of their source cells.
+	 * The claimed regions cover the whole grid so they always join every group. Costs O(cells log cells + rooms), with about as many cells as rooms
+	 * @param GetGroup - returns the group of a room
+	 * @param OutBridges - connections between rooms of different groups. May contain duplicates
+	 */
+	void FindGroupBridges(TFunctionRef<int32(int32)> GetGroup, TArray<FRoomConnectionCandidate>& OutBridges) const
+	{
+		OutBridges.Reset();
+
+		const int32 CellsNum = CellRows * CellColumns;
+		TArray<int32> CellGroups;
+		CellGroups.Init(INDEX_NONE, CellsNum);
+		TArray<int32> CellSources;
+		CellSources.Init(INDEX_NONE, CellsNum);
+		TArray<int32> Queue;
+		Queue.Reserve(CellsNum);
+
+		//Source cell pairs that meet, packed as (SourceA << 32) | SourceB
+		TArray<int64> SourcePairs;
+
+		for (int32 Cell = 0; Cell < CellsNum; Cell++)
+		{
+			if (CellStart[Cell] == CellStart[Cell + 1])
+			{
+				continue;
+			}
+			CellGroups[Cell] = GetGroup(CellRooms[CellStart[Cell]]);
+			CellSources[Cell] = Cell;
+			Queue.Add(Cell);
+
+			//Rooms of other groups that share the cell connect to the closest room of the cell's group,
+			//so every cell holds a single group once its bridges are in
+			for (int32 i = CellStart[Cell] + 1; i < CellStart[Cell + 1]; i++)
+			{
+				if (GetGroup(CellRooms[i]) == CellGroups[Cell])
+				{
+					continue;
+				}
+
+				FRoomConnectionCandidate Bridge;
+				for (int32 j = CellStart[Cell]; j < CellStart[Cell + 1]; j++)
+				{
+					if (GetGroup(CellRooms[j]) != CellGroups[Cell])
+					{
+						continue;
+					}
+					const FRoomConnectionCandidate Candidate(CellRooms[i], CellRooms[j], GetDistance(CellRooms[i], CellRooms[j]));
+					if (Bridge.RoomA == INDEX_NONE || Candidate < Bridge)
+					{
+						Bridge = Candidate;
+					}
+				}
+				OutBridges.Add(Bridge);
+			}
+		}
+
+		static const int32 RowOffsets[] = { -1, 0, 0, 1 };
+		static const int32 ColumnOffsets[] = { 0, -1, 1, 0 };
+		for (int32 Head = 0; Head < Queue.Num(); Head++)
 		{
-			for (int32 j = 0; j < OccupiedTilesB.Num(); j++)
+			const int32 Cell = Queue[Head];
+			for (int32 i = 0; i < 4; i++)
 			{
-				TileConnections.Add(FTileConnection(OccupiedTilesA[i], OccupiedTilesB[j]));
+				const int32 Row = Cell / CellColumns + RowOffsets[i];
+				const int32 Column = Cell % CellColumns + ColumnOffsets[i];
+				if (Row < 0 || Row >= CellRows || Column < 0 || Column >= CellColumns)
+				{
+					continue;
+				}
+
+				const int32 NearbyCell = Row * CellColumns + Column;
+				if (CellGroups[NearbyCell] == INDEX_NONE)
+				{
+					CellGroups[NearbyCell] = CellGroups[Cell];
+					CellSources[NearbyCell] = CellSources[Cell];
+					Queue.Add(NearbyCell);
+				}
+				else if (CellGroups[NearbyCell] != CellGroups[Cell])
+				{
+					SourcePairs.Add(PackIndexPair(FMath::Min(CellSources[Cell], CellSources[NearbyCell]), FMath::Max(CellSources[Cell], CellSources[NearbyCell])));
+				}
+			}
+		}
+
+		//Regions of two sources usually share a long border
+		SourcePairs.Sort();
+		for (int32 i = 0; i < SourcePairs.Num(); i++)
+		{
+			if (i > 0 && SourcePairs[i] == SourcePairs[i - 1])
+			{
+				continue;
+			}
+
+			//Closest rooms of different groups between the two cells
+			const int32 CellA = GetPackedFirst(SourcePairs[i]);
+			const int32 CellB = GetPackedSecond(SourcePairs[i]);
+			FRoomConnectionCandidate Bridge;
+			for (int32 A = CellStart[CellA]; A < CellStart[CellA + 1]; A++)
+			{
+				const int32 GroupA = GetGroup(CellRooms[A]);
+				for (int32 B = CellStart[CellB]; B < CellStart[CellB + 1]; B++)
+				{
+					if (GetGroup(CellRooms[B]) == GroupA)
+					{
+						continue;
+					}
+					const FRoomConnectionCandidate Candidate(CellRooms[A], CellRooms[B], GetDistance(CellRooms[A], CellRooms[B]));
+					if (Bridge.RoomA == INDEX_NONE || Candidate < Bridge)
+					{
+						Bridge = Candidate;
+					}
+				}
+			}
+
+			if (Bridge.RoomA != INDEX_NONE)
+			{
+				OutBridges.Add(Bridge);
 			}
 		}
 	}
 
-	//Find shortest route
-	//TODO: If PathLength == 1 rooms already connected
-	int32 PathLength = MAX_int32;
-	FTileConnection Path;
+private:
+
+	const TArray<TTuple<int32, int32>>& RoomCenters;
+
+	/* Size of each cell in doubled tile coordinates */
+	int32 CellSize;
+	int32 CellRows;
+	int32 CellColumns;
+
+	/* Rooms of cell i are CellRooms[CellStart[i]] to CellRooms[CellStart[i + 1] - 1] */
+	TArray<int32> CellStart;
+	TArray<int32> CellRooms;
+
+	inline int32 GetCell(int32 RoomIndex) const
+	{
+		const int32 Row = FMath::Clamp(RoomCenters[RoomIndex].Key / CellSize, 0, CellRows - 1);
+		const int32 Column = FMath::Clamp(RoomCenters[RoomIndex].Value / CellSize, 0, CellColumns - 1);
+		return Row * CellColumns + Column;
+	}
+
+	inline int64 GetDistance(int32 A, int32 B) const
+	{
+		return FMath::Square(int64(RoomCenters[A].Key - RoomCenters[B].Key)) + FMath::Square(int64(RoomCenters[A].Value - RoomCenters[B].Value));
+	}
+
+	/**
+	 * Inserts a candidate in a list that is sorted by distance and holds up to Count elements
+	 */
+	static void AddNearestRoom(const FRoomConnectionCandidate& Candidate, int32 Count, TArray<FRoomConnectionCandidate>& Nearest)
+	{
+		if (Nearest.Num() == Count)
+		{
+			if (!(Candidate < Nearest.Last()))
+			{
+				return;
+			}
+			Nearest.Pop();
+		}
+
+		int32 Index = Nearest.Num();
+		Nearest.Add(Candidate);
+		while (Index > 0 && Candidate < Nearest[Index - 1])
+		{
+			Nearest[Index] = Nearest[Index - 1];
+			Index--;
+		}
+		Nearest[Index] = Candidate;
+	}
+};
+
+/**
+ * Union-find over room indices
+ */
+struct FRoomSets
+{
+	TArray<int32> Parents;
+	TArray<int32> Sizes;
+
+	explicit FRoomSets(int32 Count)
+	{
+		Parents.SetNumUninitialized(Count);
+		Sizes.Init(1, Count);
+		for (int32 i = 0; i < Count; i++)
+		{
+			Parents[i] = i;
+		}
+	}
+
+	int32 Find(int32 Room)
+	{
+		while (Parents[Room] != Room)
+		{
+			Parents[Room] = Parents[Parents[Room]];
+			Room = Parents[Room];
+		}
+		return Room;
+	}
+
+	/**
+	 * @return true if A and B were in different sets
+	 */
+	bool Union(int32 A, int32 B)
+	{
+		A = Find(A);
+		B = Find(B);
+		if (A == B)
+		{
+			return false;
+		}
+		if (Sizes[A] < Sizes[B])
+		{
+			Swap(A, B);
+		}
+		Parents[B] = A;
+		Sizes[A] += Sizes[B];
+		return true;
+	}
+};
+
+void FTileMatrix::ConnectGeneratedRooms()
+{
+	const int32 RoomsNum = GeneratedRooms.Num();
+	if (IsCancelled())
+	{
+		return;
+	}
+	if (RoomConnectivity != ERoomConnectivity::MinimumSpanningTree || RoomsNum < 2)
+	{
+		RebuildLayoutGraph();
+		return;
+	}
+
+	TArray<TTuple<int32, int32>> RoomCenters;
+	RoomCenters.SetNumUninitialized(RoomsNum);
+	for (int32 i = 0; i < RoomsNum; i++)
+	{
+		const FRoomRect Room = GeneratedRooms.Get(i);
+		RoomCenters[i] = TTuple<int32, int32>(Room.MinRow + Room.MaxRow, Room.MinColumn + Room.MaxColumn);
+	}
+	const FRoomCenterGrid CenterGrid(RoomCenters, RowsNum, ColumnsNum);
+
+	//Candidate graph: each room and its nearest rooms
+	const int32 CandidatesPerRoom = FMath::Clamp(ConnectionCandidatesPerRoom, 1, RoomsNum - 1);
+	TArray<FRoomConnectionCandidate> Candidates;
+	Candidates.Reserve(RoomsNum * CandidatesPerRoom);
+
+	TArray<FRoomConnectionCandidate> NearestRooms;
+	for (int32 i = 0; i < RoomsNum; i++)
+	{
+		CenterGrid.FindNearestRooms(i, CandidatesPerRoom, [](int32) { return true; }, NearestRooms);
+		Candidates.Append(NearestRooms);
+	}
 
-	for (int32 i = 0; i < TileConnections.Num(); i++)
+	//Sort by length and drop the connections that were found from both rooms
+	Candidates.Sort();
+	int32 UniqueCandidatesNum = 0;
+	for (int32 i = 0; i < Candidates.Num(); i++)
 	{
-		if (TileConnections[i].Length() < PathLength)
+		if (UniqueCandidatesNum == 0 || Candidates[UniqueCandidatesNum - 1].RoomA != Candidates[i].RoomA || Candidates[UniqueCandidatesNum - 1].RoomB != Candidates[i].RoomB)
 		{
-			Path = TileConnections[i];
-			PathLength = TileConnections[i].Length();
+			Candidates[UniqueCandidatesNum++] = Candidates[i];
 		}
 	}
+	Candidates.SetNum(UniqueCandidatesNum);
 
-	Tile PivotTile = Path.Start;
+	//Kruskal
+	FRoomSets RoomSets(RoomsNum);
+	TArray<FRoomConnectionCandidate> Connections;
+	TArray<FRoomConnectionCandidate> ExtraCandidates;
+	Connections.Reserve(RoomsNum - 1);
+	for (int32 i = 0; i < Candidates.Num(); i++)
+	{
+		if (RoomSets.Union(Candidates[i].RoomA, Candidates[i].RoomB))
+		{
+			Connections.Add(Candidates[i]);
+		}
+		else
+		{
+			ExtraCandidates.Add(Candidates[i]);
+		}
+	}
 
-	while (PathLength > 1)
+	//Clustered rooms may end up with a nearest neighbor graph in more than one piece.
+	//Join the pieces along the borders of the grid cells each piece is closest to, shortest bridges first
+	if (Connections.Num() < RoomsNum - 1)
 	{
-		TArray<Tile> NearbyTiles = GetNearbyTiles(PivotTile);
-		int32 TempPath = MAX_int32;
-		Tile ClosestTile;
-		//Get closest tile to target based on the nearby tiles
-		for (int32 i = 0; i < NearbyTiles.Num(); i++)
+		TArray<FRoomConnectionCandidate> Bridges;
+		CenterGrid.FindGroupBridges([&RoomSets](int32 Room) { return RoomSets.Find(Room); }, Bridges);
+		Bridges.Sort();
+		for (int32 i = 0; i < Bridges.Num(); i++)
 		{
-			if (ManhattanDistance(NearbyTiles[i], Path.End) < TempPath)
+			if (RoomSets.Union(Bridges[i].RoomA, Bridges[i].RoomB))
 			{
-				TempPath = ManhattanDistance(NearbyTiles[i], Path.End);
-				ClosestTile = NearbyTiles[i];
+				Connections.Add(Bridges[i]);
 			}
 		}
-
-		//GLog->Log("Added path on:"+TileToString(ClosestTile));
-		OccupyTile(ClosestTile);
-		PivotTile = ClosestTile;
-		PathLength = ManhattanDistance(PivotTile, Path.End);
+		ensure(Connections.Num() == RoomsNum - 1);
+	}
+
+	//Loops
+	const int32 ExtraConnectionsNum = FMath::RoundToInt(FMath::Clamp(ExtraConnectionsRatio, 0.f, 1.f) * ExtraCandidates.Num());
+	Connections.Append(ExtraCandidates.GetData(), ExtraConnectionsNum);
+
+	for (int32 i = 0; i < Connections.Num() && !IsCancelled(); i++)
+	{
+		ConnectRooms(GeneratedRooms.Get(Connections[i].RoomA), GeneratedRooms.Get(Connections[i].RoomB));
+	}
+
+	RebuildLayoutGraph();
+}
+
+FTileMatrix::FTileMatrix()
+{
+	//Init
+	RowsNum = -1;
+	ColumnsNum = -1;
+	GeneratedRooms.Empty();
+	RandomStream.GenerateNewSeed();
+}
+
+FTileMatrix::FTileMatrix(int32 RowCount, int32 ColumnCount)
+{
+	InitTileMap(RowCount, ColumnCount);
+	RandomStream.GenerateNewSeed();
+}
+
+void FTileMatrix::InitTileMap(int32 Rows, int32 Columns)
+{
+	RowsNum = Rows;
+	ColumnsNum = Columns;
+
+	TileMap.Init(Rows, Columns);
+	OccupancyCounts.Init(TileMap);
+	TileCosts.Init(RoutingCosts.EmptyTileCost, FMath::Max(Rows, 0) * FMath::Max(Columns, 0));
+	TileLabels.Init(EmptyTileLabel, FMath::Max(Rows, 0) * FMath::Max(Columns, 0));
+	RoomConnections.Empty();
+}
+
+FString FTileMatrix::TileToString(const Tile& InTile) const
+{
+	return FString("[") + FString::FromInt(InTile.Key) + "," + FString::FromInt(InTile.Value) + FString("]");
+}
+
+void FTileMatrix::SetRoomSize(int32 NewMinRoomSize, int32 NewMaxRoomSize)
+{
+	MinRoomSize = NewMinRoomSize;
+	MaxRoomSize = NewMaxRoomSize;
+}
+
+FTileMatrix::Tile FTileMatrix::GetRandomTile() const
+{
+	return Tile(RandomStream.RandRange(0, RowsNum - 1), RandomStream.RandRange(0, ColumnsNum - 1));
+}
+
+bool FTileMatrix::IsTileInMap(const Tile& InTile) const
+{
+	return TileMap.IsValidIndex(InTile.Key, InTile.Value);
+}
+
+bool FTileMatrix::IsTileOccupied(Tile InTile) const
+{
+	if (IsTileInMap(InTile))
+	{
+		return TileMap.Get(InTile.Key, InTile.Value);
+	}
+	return false;
+}
+
+bool FTileMatrix::IsAreaAvailable(int32 MinRow, int32 MinColumn, int32 MaxRow, int32 MaxColumn) const
+{
+	if (MinRow > MaxRow || MinColumn > MaxColumn || !IsTileInMap(Tile(MinRow, MinColumn)) || !IsTileInMap(Tile(MaxRow, MaxColumn)))
+	{
+		return false;
+	}
+	return OccupancyCounts.IsRectEmpty(TileMap, MinRow, MinColumn, MaxRow, MaxColumn);
+}
+
+bool FTileMatrix::GetLeftTile(const Tile& InTile, Tile& LeftTile) const
+{
+	if (IsTileInMap(InTile))
+	{
+		LeftTile = InTile;
+		LeftTile.Value--;
+		return IsTileInMap(LeftTile);
+	}
+	return false;
+}
+
+bool FTileMatrix::GetRightTile(const Tile& InTile, Tile& RightTile) const
+{
+	if (IsTileInMap(InTile))
+	{
+		RightTile = InTile;
+		RightTile.Value++;
+		return IsTileInMap(RightTile);
+	}
+	return false;
+}
+
+bool FTileMatrix::GetUpTile(const Tile& InTile, Tile& UpTile) const
+{
+	if (IsTileInMap(InTile))
+	{
+		UpTile = InTile;
+		UpTile.Key--;
+		return IsTileInMap(UpTile);
+	}
+	return false;
+}
+
+bool FTileMatrix::GetDownTile(const Tile& InTile, Tile& DownTile) const
+{
+	if (IsTileInMap(InTile))
+	{
+		DownTile = InTile;
+		DownTile.Key++;
+		return IsTileInMap(DownTile);
+	}
+	return false;
+}
+
+uint8 FTileMatrix::GetWallSides(const Tile& InTile) const
+{
+	//Get nearby tile for each direction.
+	//Store a wall if:
+	//The nearby tile isn't occupied OR
+	//The nearby tile is out of bounds from the tilemap (means we're on the edge of the tiles)
+	//The nearby tile is out of bounds from the tilemap but the border portal continues in the neighbor tile map
+	const bool bIsBorderPortal = IsBorderPortal(InTile);
+	uint8 WallSides = 0;
+	Tile NearbyTile;
+
+	if (GetUpTile(InTile, NearbyTile) ? !IsTileOccupied(NearbyTile) : !bIsBorderPortal)
+	{
+		WallSides |= WallSideUp;
+	}
+	if (GetRightTile(InTile, NearbyTile) ? !IsTileOccupied(NearbyTile) : !bIsBorderPortal)
+	{
+		WallSides |= WallSideRight;
+	}
+	if (GetDownTile(InTile, NearbyTile) ? !IsTileOccupied(NearbyTile) : !bIsBorderPortal)
+	{
+		WallSides |= WallSideDown;
+	}
+	if (GetLeftTile(InTile, NearbyTile) ? !IsTileOccupied(NearbyTile) : !bIsBorderPortal)
+	{
+		WallSides |= WallSideLeft;
+	}
+	return WallSides;
+}
+
+void FTileMatrix::AppendWallSpawnPoints(const Tile& CenterTile, float TileSize, TArray<FWallSpawnPoint>& OutWalls) const
+{
+	FVector FloorCenter = FVector(CenterTile.Key * TileSize, CenterTile.Value * TileSize, 0);
+	//up = -x
+	//left = -y
+	//down = +x
+	//right = +y
+	const uint8 WallSides = GetWallSides(CenterTile);
+
+	if (WallSides & WallSideUp)
+	{
+		FVector WallLocation = FloorCenter - FVector(TileSize / 2.f, 0.f, 0.f);
+		OutWalls.Add(FWallSpawnPoint(WallLocation));
+	}
+	if (WallSides & WallSideRight)
+	{
+		FVector WallLocation = FloorCenter + FVector(0.f, TileSize / 2.f, 0.f);
+		OutWalls.Add(FWallSpawnPoint(WallLocation, false));
+	}
+	if (WallSides & WallSideDown)
+	{
+		FVector WallLocation = FloorCenter + FVector(TileSize / 2.f, 0.f, 0.f);
+		OutWalls.Add(FWallSpawnPoint(WallLocation));
+	}
+	if (WallSides & WallSideLeft)
+	{
+		FVector WallLocation = FloorCenter - FVector(0.f, TileSize / 2.f, 0.f);
+		OutWalls.Add(FWallSpawnPoint(WallLocation, false));
+	}
+}
+
+/**
+ * Tracks a run of contiguous wall edges along a grid line while the tiles next to the line are visited in order
+ */
+struct FWallRun
+{
+	/* Grid line i lies between tiles i - 1 and i */
+	int32 Line = 0;
+
+	/* True for up & down walls (spread along Y) */
+	bool bFacingX = true;
+
+	int32 FirstTile = 0;
+	int32 Length = 0;
+
+	FWallRun(int32 InLine, bool bInFacingX)
+	{
+		Line = InLine;
+		bFacingX = bInFacingX;
+	}
+
+	/**
+	 * Extends the run with the edge of a tile or emits the run and starts a new one
+	 */
+	inline void Add(int32 TileIndex, int32 MaxLength, float TileSize, TArray<FTileMatrix::FWallSpawnPoint>& OutWalls)
+	{
+		if (Length > 0 && FirstTile + Length == TileIndex && Length < MaxLength)
+		{
+			Length++;
+			return;
+		}
+		Flush(TileSize, OutWalls);
+		FirstTile = TileIndex;
+		Length = 1;
+	}
+
+	inline void Flush(float TileSize, TArray<FTileMatrix::FWallSpawnPoint>& OutWalls)
+	{
+		if (Length == 0)
+		{
+			return;
+		}
+
+		const float LineLocation = (Line - 0.5f) * TileSize;
+		const float CenterLocation = (FirstTile + (Length - 1) / 2.f) * TileSize;
+		const FVector WallLocation = bFacingX ? FVector(LineLocation, CenterLocation, 0.f) : FVector(CenterLocation, LineLocation, 0.f);
+		OutWalls.Add(FTileMatrix::FWallSpawnPoint(WallLocation, bFacingX, Length));
+		Length = 0;
+	}
+};
+
+void FTileMatrix::AppendMergedRowWalls(const FTileBitGrid& Mask, int32 FirstRow, int32 FirstColumn, int32 FirstMaskRow, int32 LastMaskRow, float TileSize, TArray<FWallSpawnPoint>& OutWalls) const
+{
+	const int32 MaxLength = MaxWallSegmentLength > 0 ? MaxWallSegmentLength : MAX_int32;
+
+	for (int32 MaskRow = FirstMaskRow; MaskRow <= LastMaskRow; MaskRow++)
+	{
+		const int32 Row = FirstRow + MaskRow;
+
+		//Up walls lie on the grid line above the row and down walls on the line below it
+		FWallRun UpRun(Row, true);
+		FWallRun DownRun(Row + 1, true);
+
+		for (int32 Word = 0; Word < Mask.GetWordsPerRow(); Word++)
+		{
+			uint64 Bits = Mask.GetWord(MaskRow, Word);
+			while (Bits)
+			{
+				const int32 Column = FirstColumn + Word * FTileBitGrid::BitsPerWord + (int32)FMath::CountTrailingZeros64(Bits);
+				Bits &= Bits - 1;
+
+				const uint8 WallSides = GetWallSides(Tile(Row, Column));
+				if (WallSides & WallSideUp)
+				{
+					UpRun.Add(Column, MaxLength, TileSize, OutWalls);
+				}
+				else
+				{
+					UpRun.Flush(TileSize, OutWalls);
+				}
+				if (WallSides & WallSideDown)
+				{
+					DownRun.Add(Column, MaxLength, TileSize, OutWalls);
+				}
+				else
+				{
+					DownRun.Flush(TileSize, OutWalls);
+				}
+			}
+		}
+
+		UpRun.Flush(TileSize, OutWalls);
+		DownRun.Flush(TileSize, OutWalls);
+	}
+}
+
+void FTileMatrix::AppendMergedColumnWalls(const FTileBitGrid& Mask, int32 FirstRow, int32 FirstColumn, int32 FirstMaskColumn, int32 LastMaskColumn, float TileSize, TArray<FWallSpawnPoint>& OutWalls) const
+{
+	const int32 MaxLength = MaxWallSegmentLength > 0 ? MaxWallSegmentLength : MAX_int32;
+
+	for (int32 MaskColumn = FirstMaskColumn; MaskColumn <= LastMaskColumn; MaskColumn++)
+	{
+		const int32 Column = FirstColumn + MaskColumn;
+
+		//Left walls lie on the grid line left of the column and right walls on the line right of it
+		FWallRun LeftRun(Column, false);
+		FWallRun RightRun(Column + 1, false);
+
+		for (int32 MaskRow = 0; MaskRow < Mask.GetRowsNum(); MaskRow++)
+		{
+			if (!Mask.Get(MaskRow, MaskColumn))
+			{
+				continue;
+			}
+
+			const int32 Row = FirstRow + MaskRow;
+			const uint8 WallSides = GetWallSides(Tile(Row, Column));
+			if (WallSides & WallSideLeft)
+			{
+				LeftRun.Add(Row, MaxLength, TileSize, OutWalls);
+			}
+			else
+			{
+				LeftRun.Flush(TileSize, OutWalls);
+			}
+			if (WallSides & WallSideRight)
+			{
+				RightRun.Add(Row, MaxLength, TileSize, OutWalls);
+			}
+			else
+			{
+				RightRun.Flush(TileSize, OutWalls);
+			}
+		}
+
+		LeftRun.Flush(TileSize, OutWalls);
+		RightRun.Flush(TileSize, OutWalls);
+	}
+}
+
+void FTileMatrix::AppendMergedFloors(FTileBitGrid& Mask, int32 FirstMaskRow, int32 LastMaskRow, int32 FirstRow, int32 FirstColumn, float TileSize, TArray<FFloorSpawnPoint>& OutFloors) const
+{
+	const int32 MaxSize = MaxFloorRectSize > 0 ? MaxFloorRectSize : MAX_int32;
+
+	for (int32 Row = FirstMaskRow; Row <= LastMaskRow; Row++)
+	{
+		//Covered tiles get cleared so keep reading the same word until it's empty
+		for (int32 Word = 0; Word < Mask.GetWordsPerRow();)
+		{
+			const uint64 Bits = Mask.GetWord(Row, Word);
+			if (!Bits)
+			{
+				Word++;
+				continue;
+			}
+
+			const int32 Column = Word * FTileBitGrid::BitsPerWord + (int32)FMath::CountTrailingZeros64(Bits);
+
+			int32 Width = 1;
+			while (Width < MaxSize && Mask.IsValidIndex(Row, Column + Width) && Mask.Get(Row, Column + Width))
+			{
+				Width++;
+			}
+
+			int32 Height = 1;
+			while (Height < MaxSize && Row + Height <= LastMaskRow && Mask.IsRowSpanFull(Row + Height, Column, Column + Width - 1))
+			{
+				Height++;
+			}
+
+			for (int32 i = 0; i < Height; i++)
+			{
+				Mask.ClearRowSpan(Row + i, Column, Column + Width - 1);
+			}
+
+			const FVector RectCenter = FVector((FirstRow + Row + (Height - 1) / 2.f) * TileSize, (FirstColumn + Column + (Width - 1) / 2.f) * TileSize, 0.f);
+			OutFloors.Add(FFloorSpawnPoint(RectCenter, Height, Width));
+		}
+	}
+}
+
+/**
+ * Floors & walls projected by a single block of rows (or columns) of a tile group
+ */
+struct FProjectionBlock
+{
+	TArray<FTileMatrix::FFloorSpawnPoint> Floors;
+	TArray<FTileMatrix::FWallSpawnPoint> Walls;
+};
+
+void FTileMatrix::ProjectTileGroup(const FTileBitGrid& Mask, int32 FirstRow, int32 FirstColumn, float TileSize, bool bParallel, TArray<FFloorSpawnPoint>& OutFloors, TArray<FWallSpawnPoint>& OutWalls) const
+{
+	const int32 MaskRows = Mask.GetRowsNum();
+	const int32 MaskColumns = Mask.GetColumnsNum();
+	if (MaskRows == 0 || MaskColumns == 0)
+	{
+		return;
+	}
+
+	//Merged left & right walls run along the columns so they get their own blocks of columns
+	const int32 RowBlocksNum = FMath::DivideAndRoundUp(MaskRows, ProjectionBlockSize);
+	const int32 ColumnBlocksNum = bMergeWalls ? FMath::DivideAndRoundUp(MaskColumns, ProjectionBlockSize) : 0;
+
+	//Merged floors clear the tiles they cover. Each block only touches the words of its own rows so they share the copy
+	FTileBitGrid FloorMask;
+	if (bMergeFloors)
+	{
+		FloorMask = Mask;
+	}
+
+	TArray<FProjectionBlock> Blocks;
+	Blocks.SetNum(RowBlocksNum + ColumnBlocksNum);
+
+	ParallelFor(Blocks.Num(), [&](int32 BlockIndex)
+	{
+		FProjectionBlock& Block = Blocks[BlockIndex];
+
+		if (BlockIndex >= RowBlocksNum)
+		{
+			const int32 FirstMaskColumn = (BlockIndex - RowBlocksNum) * ProjectionBlockSize;
+			const int32 LastMaskColumn = FMath::Min(FirstMaskColumn + ProjectionBlockSize, MaskColumns) - 1;
+			AppendMergedColumnWalls(Mask, FirstRow, FirstColumn, FirstMaskColumn, LastMaskColumn, TileSize, Block.Walls);
+			return;
+		}
+
+		const int32 FirstMaskRow = BlockIndex * ProjectionBlockSize;
+		const int32 LastMaskRow = FMath::Min(FirstMaskRow + ProjectionBlockSize, MaskRows) - 1;
+
+		if (bMergeFloors)
+		{
+			AppendMergedFloors(FloorMask, FirstMaskRow, LastMaskRow, FirstRow, FirstColumn, TileSize, Block.Floors);
+		}
+		if (bMergeWalls)
+		{
+			AppendMergedRowWalls(Mask, FirstRow, FirstColumn, FirstMaskRow, LastMaskRow, TileSize, Block.Walls);
+		}
+		if (bMergeFloors && bMergeWalls)
+		{
+			return;
+		}
+
+		//Size the buffers of the block once: a floor per tile and usually less than a wall per tile
+		int32 BlockTilesNum = 0;
+		for (int32 MaskRow = FirstMaskRow; MaskRow <= LastMaskRow; MaskRow++)
+		{
+			for (int32 Word = 0; Word < Mask.GetWordsPerRow(); Word++)
+			{
+				BlockTilesNum += (int32)FMath::CountBits(Mask.GetWord(MaskRow, Word));
+			}
+		}
+		if (!bMergeFloors)
+		{
+			Block.Floors.Reserve(BlockTilesNum);
+		}
+		if (!bMergeWalls)
+		{
+			Block.Walls.Reserve(BlockTilesNum);
+		}
+
+		for (int32 MaskRow = FirstMaskRow; MaskRow <= LastMaskRow; MaskRow++)
+		{
+			const int32 Row = FirstRow + MaskRow;
+
+			//Skip empty words and only visit the occupied tiles of each word
+			for (int32 Word = 0; Word < Mask.GetWordsPerRow(); Word++)
+			{
+				uint64 Bits = Mask.GetWord(MaskRow, Word);
+				while (Bits)
+				{
+					const int32 Column = FirstColumn + Word * FTileBitGrid::BitsPerWord + (int32)FMath::CountTrailingZeros64(Bits);
+					Bits &= Bits - 1;
+
+					if (!bMergeFloors)
+					{
+						Block.Floors.Add(FFloorSpawnPoint(FVector(Row * TileSize, Column * TileSize, 0)));
+					}
+					if (!bMergeWalls)
+					{
+						AppendWallSpawnPoints(Tile(Row, Column), TileSize, Block.Walls);
+					}
+				}
+			}
+		}
+	}, bParallel ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
+
+	//Concatenate the blocks in order so the output doesn't depend on the number of threads
+	int32 FloorsNum = 0;
+	int32 WallsNum = 0;
+	for (int32 i = 0; i < Blocks.Num(); i++)
+	{
+		FloorsNum += Blocks[i].Floors.Num();
+		WallsNum += Blocks[i].Walls.Num();
+	}
+	OutFloors.Reserve(OutFloors.Num() + FloorsNum);
+	OutWalls.Reserve(OutWalls.Num() + WallsNum);
+	for (int32 i = 0; i < Blocks.Num(); i++)
+	{
+		OutFloors.Append(Blocks[i].Floors);
+		OutWalls.Append(Blocks[i].Walls);
+	}
+}
+
+void FTileMatrix::OccupyTile(const Tile& InTile)
+{
+	TileMap.Set(InTile.Key, InTile.Value);
+	OccupancyCounts.UpdateRow(TileMap, InTile.Key, InTile.Value);
+}
+
+void FTileMatrix::OccupyRoomTiles(const FRoomRect& Room, int32 RoomIndex)
+{
+	for (int32 i = Room.MinRow; i <= Room.MaxRow; i++)
+	{
+		TileMap.SetRowSpan(i, Room.MinColumn, Room.MaxColumn);
+		OccupancyCounts.UpdateRow(TileMap, i, Room.MinColumn);
+		for (int32 j = Room.MinColumn; j <= Room.MaxColumn; j++)
+		{
+			TileCosts[i * ColumnsNum + j] = RoutingCosts.RoomTileCost;
+			TileLabels[i * ColumnsNum + j] = static_cast<uint16>(RoomIndex + 1);
+		}
+	}
+}
+
+void FTileMatrix::OccupyCorridorTile(int32 Row, int32 Column)
+{
+	//Corridors that cross rooms don't turn the room tiles into corridor tiles
+	if (!TileMap.Get(Row, Column))
+	{
+		TileCosts[Row * ColumnsNum + Column] = RoutingCosts.CorridorTileCost;
+		TileLabels[Row * ColumnsNum + Column] = CorridorLabelFlag;
+		OccupyTile(Tile(Row, Column));
+	}
+}
+
+void FTileMatrix::OccupyCorridorRowSpan(int32 Row, int32 FirstColumn, int32 LastColumn)
+{
+	if (FirstColumn > LastColumn)
+	{
+		return;
+	}
+
+	uint8* RowCosts = TileCosts.GetData() + Row * ColumnsNum;
+	uint16* RowLabels = TileLabels.GetData() + Row * ColumnsNum;
+	for (int32 j = FirstColumn; j <= LastColumn; j++)
+	{
+		if (!TileMap.Get(Row, j))
+		{
+			RowCosts[j] = RoutingCosts.CorridorTileCost;
+			RowLabels[j] = CorridorLabelFlag;
+		}
+	}
+	TileMap.SetRowSpan(Row, FirstColumn, LastColumn);
+	OccupancyCounts.UpdateRow(TileMap, Row, FirstColumn);
+}
+
+void FTileMatrix::OccupyCorridorColumnSpan(int32 Column, int32 FirstRow, int32 LastRow)
+{
+	for (int32 i = FirstRow; i <= LastRow; i++)
+	{
+		OccupyCorridorTile(i, Column);
+	}
+}
+
+void FTileMatrix::SetTileCost(int32 Row, int32 Column, uint8 Cost)
+{
+	if (TileMap.IsValidIndex(Row, Column))
+	{
+		TileCosts[Row * ColumnsNum + Column] = Cost;
+	}
+}
+
+bool FTileMatrix::CreateUpperRightRoomExpansion(const Tile& StartTile, int32 ExpansionCount, FRoomRect& Room) const
+{
+	//We're moving up so the rows end on the start tile
+	//The columns expand on the left of the start tile
+	if (!IsAreaAvailable(StartTile.Key - ExpansionCount + 1, StartTile.Value - ExpansionCount, StartTile.Key, StartTile.Value - 1))
+	{
+		return false;
+	}
+	Room = FRoomRect(StartTile.Key - ExpansionCount + 1, StartTile.Value - ExpansionCount, StartTile.Key, StartTile.Value - 1);
+	return true;
+}
+
+bool FTileMatrix::CreateLowerRightRoomExpansion(const Tile& StartTile, int32 ExpansionCount, FRoomRect& Room) const
+{
+	//We're moving down so the rows start from the start tile
+	//Moving right so the columns expand on the right of the start tile
+	if (!IsAreaAvailable(StartTile.Key, StartTile.Value + 1, StartTile.Key + ExpansionCount - 1, StartTile.Value + ExpansionCount))
+	{
+		return false;
+	}
+	Room = FRoomRect(StartTile.Key, StartTile.Value + 1, StartTile.Key + ExpansionCount - 1, StartTile.Value + ExpansionCount);
+	return true;
+}
+
+bool FTileMatrix::CreateUpperLeftRoomExpansion(const Tile& StartTile, int32 ExpansionCount, FRoomRect& Room) const
+{
+	//The rows start from the start tile
+	//Moving left so the columns expand on the left of the start tile
+	if (!IsAreaAvailable(StartTile.Key, StartTile.Value - ExpansionCount, StartTile.Key + ExpansionCount - 1, StartTile.Value - 1))
+	{
+		return false;
+	}
+	Room = FRoomRect(StartTile.Key, StartTile.Value - ExpansionCount, StartTile.Key + ExpansionCount - 1, StartTile.Value - 1);
+	return true;
+}
+
+bool FTileMatrix::CreateLowerLeftRoomExpansion(const Tile& StartTile, int32 ExpansionCount, FRoomRect& Room) const
+{
+	//The rows end on the start tile
+	//Moving left so the columns expand on the left of the start tile
+	if (!IsAreaAvailable(StartTile.Key - ExpansionCount + 1, StartTile.Value - ExpansionCount, StartTile.Key, StartTile.Value - 1))
+	{
+		return false;
+	}
+	Room = FRoomRect(StartTile.Key - ExpansionCount + 1, StartTile.Value - ExpansionCount, StartTile.Key, StartTile.Value - 1);
+	return true;
+}
+
+bool FTileMatrix::CanPlaceRoomInTileMap(Tile InTile, int32 RoomSize, FRoomRect& Room) const
+{
+	if (!IsTileOccupied(InTile))
+	{
+		if (CreateUpperRightRoomExpansion(InTile, RoomSize, Room))
+		{
+			return true;
+		}
+		else if (CreateLowerRightRoomExpansion(InTile, RoomSize, Room))
+		{
+			return true;
+		}
+		else if (CreateUpperLeftRoomExpansion(InTile, RoomSize, Room))
+		{
+			return true;
+		}
+		else if (CreateLowerLeftRoomExpansion(InTile, RoomSize, Room))
+		{
+			return true;
+		}
 	}
-
-}
-
-FTileMatrix::FTileMatrix()
-{
-	//Init
-	RowsNum = -1;
-	ColumnsNum = -1;
-	GeneratedRooms.Empty();
+	return false;
 }
 
-FTileMatrix::FTileMatrix(int32 RowCount, int32 ColumnCount)
+void FTileMatrix::BuildRoomAnchors()
 {
-	InitTileMap(RowCount, ColumnCount);
+	TileMap.FindEmptySquares(FMath::Max(MinRoomSize, 1), RoomAnchors);
+	RoomAnchorCounts.Init(RoomAnchors);
 }
 
-TArray<FTileMatrix::Tile> FTileMatrix::GetNearbyTiles(const Tile& InTile) const
+int32 FTileMatrix::GetLargestRoomSizeAt(int32 Row, int32 Column, int32 MinSize, int32 MaxSize) const
 {
-	Tile UpTile = Tile(InTile.Key - 1, InTile.Value);
-	Tile RightTile = Tile(InTile.Key, InTile.Value + 1);
-	Tile LeftTile = Tile(InTile.Key, InTile.Value - 1);
-	Tile DownTile = Tile(InTile.Key + 1, InTile.Value);
-
-	TArray<Tile> NearbyTiles;
-	if (IsTileInMap(UpTile))
+	if (IsAreaAvailable(Row, Column, Row + MaxSize - 1, Column + MaxSize - 1))
 	{
-		NearbyTiles.Add(UpTile);
+		return MaxSize;
 	}
-	if (IsTileInMap(RightTile))
-	{
-		NearbyTiles.Add(RightTile);
-	}
-	if (IsTileInMap(LeftTile))
-	{
-		NearbyTiles.Add(LeftTile);
-	}
-	if (IsTileInMap(DownTile))
+
+	//Grow the square one row & column at a time
+	int32 Size = MinSize;
+	while (Size + 1 < MaxSize && IsAreaAvailable(Row + Size, Column, Row + Size, Column + Size) && IsAreaAvailable(Row, Column + Size, Row + Size - 1, Column + Size))
 	{
-		NearbyTiles.Add(DownTile);
+		Size++;
 	}
-	return NearbyTiles;
+	return Size;
 }
 
-void FTileMatrix::InitTileMap(int32 Rows, int32 Columns)
+bool FTileMatrix::SampleRoomFromFreeSpace(int32 RoomSize, FRoomRect& Room)
 {
-	RowsNum = Rows;
-	ColumnsNum = Columns;
+	const int32 AttemptsBefore = PlacementStats.PlacementAttempts;
+	const int32 MinSize = FMath::Max(MinRoomSize, 1);
+	const int32 PreferredSize = FMath::Max(RoomSize, MinSize);
+	const int32 AnchorsNum = RoomAnchorCounts.GetTotalCount();
 
-	TileMap.Empty();
-	for (int32 i = 0; i < Rows; i++)
+	int32 BestSize = 0;
+	int32 BestRow = 0;
+	int32 BestColumn = 0;
+	int32 SamplesNum = 0;
+
+	while (SamplesNum < MaxAnchorSamplesPerRoom && BestSize < PreferredSize && RoomAnchorCounts.GetTotalCount() > 0)
 	{
-		TArray<bool> SingleRow;
-		SingleRow.Reserve(Columns);
-		for (int32 j = 0; j < Columns; j++)
+		int32 Row;
+		int32 Column;
+		RoomAnchorCounts.FindNthSetBit(RoomAnchors, RandomStream.RandRange(0, RoomAnchorCounts.GetTotalCount() - 1), Row, Column);
+		PlacementStats.PlacementAttempts++;
+
+		if (!IsAreaAvailable(Row, Column, Row + MinSize - 1, Column + MinSize - 1))
+		{
+			//Occupied by a room or corridor placed after the index was built
+			RoomAnchors.Clear(Row, Column);
+			RoomAnchorCounts.UpdateRow(RoomAnchors, Row, Column);
+			PlacementStats.StaleCandidates++;
+			continue;
+		}
+
+		SamplesNum++;
+		const int32 Size = GetLargestRoomSizeAt(Row, Column, MinSize, PreferredSize);
+		if (Size > BestSize)
 		{
-			SingleRow.Add(false);
+			BestSize = Size;
+			BestRow = Row;
+			BestColumn = Column;
 		}
-		TileMap.Add(SingleRow);
 	}
-}
 
-FString FTileMatrix::TileToString(const Tile& InTile) const
-{
-	return FString("[") + FString::FromInt(InTile.Key) + "," + FString::FromInt(InTile.Value) + FString("]");
-}
+	if (BestSize == 0)
+	{
+		//No space left. Random attempts would have burned through all of their tries
+		PlacementStats.EstimatedAttemptsSaved += FMath::Max<int64>(MaxRandomAttemptsPerRoom - (PlacementStats.PlacementAttempts - AttemptsBefore), 0);
+		return false;
+	}
 
-void FTileMatrix::SetRoomSize(int32 NewMinRoomSize, int32 NewMaxRoomSize)
-{
-	MinRoomSize = NewMinRoomSize;
-	MaxRoomSize = NewMaxRoomSize;
+	Room = FRoomRect(BestRow, BestColumn, BestRow + BestSize - 1, BestColumn + BestSize - 1);
+
+	//A random tile fits this room roughly once every (tile count / anchors) attempts
+	const int64 ExpectedRandomAttempts = FMath::Min<int64>(FMath::DivideAndRoundUp<int64>(int64(RowsNum) * ColumnsNum, AnchorsNum), MaxRandomAttemptsPerRoom);
+	PlacementStats.EstimatedAttemptsSaved += FMath::Max<int64>(ExpectedRandomAttempts - (PlacementStats.PlacementAttempts - AttemptsBefore), 0);
+	return true;
 }
 
-FTileMatrix::Tile FTileMatrix::GetRandomTile() const
+bool FTileMatrix::SampleRoomFromRandomTiles(FRoomRect& Room)
 {
-	return Tile(FMath::RandRange(0, RowsNum - 1), FMath::RandRange(0, ColumnsNum - 1));
+	for (int32 j = 0; j < MaxRandomAttemptsPerRoom; j++)
+	{
+		int32 RoomSize = RandomStream.RandRange(MinRoomSize, MaxRoomSize);
+		Tile RandomTile = GetRandomTile();
+		PlacementStats.PlacementAttempts++;
+
+		if (CanPlaceRoomInTileMap(RandomTile, RoomSize, Room))
+		{
+			return true;
+		}
+	}
+	return false;
 }
 
-bool FTileMatrix::IsTileInMap(const Tile& InTile) const
+void FTileMatrix::CreateRooms(int32 RoomCount)
 {
-	return TileMap.IsValidIndex(InTile.Key) && TileMap[InTile.Key].IsValidIndex(InTile.Value);
+	PlaceRooms(RoomCount);
+	ConnectGeneratedRooms();
 }
 
-bool FTileMatrix::IsTileOccupied(Tile InTile) const
+void FTileMatrix::PlaceRooms(int32 RoomCount)
 {
-	if (IsTileInMap(InTile))
+	//Tiles of previously placed rooms stay occupied but don't belong to a room anymore
+	if (GeneratedRooms.Num() > 0)
+	{
+		for (int32 i = 0; i < TileLabels.Num(); i++)
+		{
+			if (TileLabels[i] != EmptyTileLabel)
+			{
+				TileLabels[i] = CorridorLabelFlag;
+			}
+		}
+	}
+	GeneratedRooms.Empty();
+	RoomConnections.Empty();
+	PlacementStats = FRoomPlacementStats();
+	PlacementStats.RoomsRequested = RoomCount;
+
+	const bool bSampleFromFreeSpace = bUseFreeSpaceIndex && MaxRoomSize >= FMath::Max(MinRoomSize, 1);
+	if (bSampleFromFreeSpace)
 	{
-		return (TileMap[InTile.Key])[InTile.Value];
+		BuildRoomAnchors();
 	}
-	return false;
-}
 
-bool FTileMatrix::AreTilesValid(const TArray<Tile>& InTiles) const
-{
-	bool bResult = true;
-	for (int32 i = 0; i < InTiles.Num(); i++)
+	if (RoomCount > MaxRoomsNum)
 	{
-		if (!IsTileInMap(InTiles[i]) || IsTileOccupied(InTiles[i]))
+		UE_LOG(TileMatrixLog, Warning, TEXT("Cannot place %d rooms. Placing up to %d rooms instead"), RoomCount, MaxRoomsNum);
+	}
+
+	for (int32 i = 0; i < RoomCount && GeneratedRooms.Num() < MaxRoomsNum && !IsCancelled(); i++)
+	{
+		FRoomRect Room;
+		const bool bGeneratedRandomRoom = bSampleFromFreeSpace
+			? SampleRoomFromFreeSpace(RandomStream.RandRange(MinRoomSize, MaxRoomSize), Room)
+			: SampleRoomFromRandomTiles(Room);
+
+		if (bGeneratedRandomRoom)
 		{
-			return false;
+			//Occupy tiles
+			OccupyRoomTiles(Room, GeneratedRooms.Num());
+			StoreGeneratedRoom(Room);
+			PlacementStats.RoomsPlaced++;
 		}
 	}
-	return bResult;
+
+	//The index is only valid for this batch of rooms
+	RoomAnchors.Init(0, 0);
+	RoomAnchorCounts.Init(RoomAnchors);
+
+	UE_LOG(TileMatrixLog, Log, TEXT("Placed %d/%d rooms in %d attempts (%d stale candidates, ~%lld random attempts saved)"),
+		PlacementStats.RoomsPlaced, PlacementStats.RoomsRequested, PlacementStats.PlacementAttempts, PlacementStats.StaleCandidates, PlacementStats.EstimatedAttemptsSaved);
+	//PrintDebugTileMap();
 }
 
-bool FTileMatrix::GetLeftTile(const Tile& InTile, Tile& LeftTile) const
+void FTileMatrix::PrintDebugTileMap() const
 {
-	if (IsTileInMap(InTile))
+	UE_LOG(TileMatrixLog, Warning, TEXT(" ---- Printing Debug Tile Map ---- "));
+	//GLog->Log(" ---- Printing Debug Tile Map ---- ");
+	for (int32 i = 0; i < RowsNum; i++)
 	{
-		LeftTile = InTile;
-		LeftTile.Value--;
-		return IsTileInMap(LeftTile);
+		FString Row;
+		for (int32 j = 0; j < ColumnsNum - 1; j++)
+		{
+			FString ElementStr = (TileMap.Get(i, j)) ? FString("1") : FString("0");
+			ElementStr.Append(" - ");
+			Row.Append(ElementStr);
+		}
+		FString ElementStr = (TileMap.Get(i, ColumnsNum - 1)) ? FString("1") : FString("0");
+		Row.Append(ElementStr);
+		
+		//GLog->Log(Row);
+		UE_LOG(TileMatrixLog, Warning, TEXT("%s"), *FString(Row));
 	}
-	return false;
+
+	UE_LOG(TileMatrixLog, Warning, TEXT(" ---- End Of Printing Debug Tile Map ----"));
+	//GLog->Log(" ---- End Of Printing Debug Tile Map ----");
 }
 
-bool FTileMatrix::GetRightTile(const Tile& InTile, Tile& RightTile) const
+uint32 FTileMatrix::GetLayoutHash() const
 {
-	if (IsTileInMap(InTile))
+	uint32 Hash = FCrc::MemCrc32(&RowsNum, sizeof(RowsNum));
+	Hash = FCrc::MemCrc32(&ColumnsNum, sizeof(ColumnsNum), Hash);
+	for (int32 i = 0; i < TileMap.GetRowsNum(); i++)
 	{
-		RightTile = InTile;
-		RightTile.Value++;
-		return IsTileInMap(RightTile);
+		Hash = FCrc::MemCrc32(TileMap.GetRowData(i), TileMap.GetWordsPerRow() * sizeof(uint64), Hash);
 	}
-	return false;
+	return Hash;
 }
 
-bool FTileMatrix::GetUpTile(const Tile& InTile, Tile& UpTile) const
+void FTileMatrix::Serialize(FArchive& Ar)
 {
-	if (IsTileInMap(InTile))
+	int32 Version = static_cast<int32>(ELayoutVersion::LatestVersion);
+	Ar << Version;
+	if (Ar.IsLoading() && Version != static_cast<int32>(ELayoutVersion::LatestVersion))
 	{
-		UpTile = InTile;
-		UpTile.Key--;
-		return IsTileInMap(UpTile);
+		Ar.SetError();
+		return;
 	}
-	return false;
-}
 
-bool FTileMatrix::GetDownTile(const Tile& InTile, Tile& DownTile) const
-{
-	if (IsTileInMap(InTile))
+	TileMap.Serialize(Ar);
+
+	int32 RoomsNum = GeneratedRooms.Num();
+	Ar << RoomsNum;
+
+	if (Ar.IsLoading())
 	{
-		DownTile = InTile;
-		DownTile.Key++;
-		return IsTileInMap(DownTile);
+		RowsNum = TileMap.GetRowsNum();
+		ColumnsNum = TileMap.GetColumnsNum();
+		OccupancyCounts.Init(TileMap);
+		GeneratedRooms.Empty();
+
+		//Every room has at least one tile
+		if (Ar.IsError() || RoomsNum < 0 || RoomsNum > TileMap.CountSetBits() || RoomsNum > MaxRoomsNum)
+		{
+			Ar.SetError();
+			return;
+		}
+		GeneratedRooms.Reserve(RoomsNum);
 	}
-	return false;
-}
 
-TArray<FTileMatrix::FWallSpawnPoint> FTileMatrix::GenerateWallSpawnPointsFromNearbyTiles(const Tile& CenterTile, float TileSize) const
-{
-	TArray<FWallSpawnPoint> WallSpawnPoints;
+	for (int32 i = 0; i < RoomsNum; i++)
+	{
+		FRoomRect Room = (Ar.IsLoading()) ? FRoomRect() : GeneratedRooms.Get(i);
+		Ar << Room.MinRow;
+		Ar << Room.MinColumn;
+		Ar << Room.MaxRow;
+		Ar << Room.MaxColumn;
 
-	FVector FloorCenter = FVector(CenterTile.Key * TileSize, CenterTile.Value * TileSize, 0);
-	//up = -x
-	//left = -y
-	//down = +x
-	//right = +y
-	Tile NearbyTile;
+		if (Ar.IsLoading())
+		{
+			if (Ar.IsError() || !IsTileInMap(Tile(Room.MinRow, Room.MinColumn)) || !IsTileInMap(Tile(Room.MaxRow, Room.MaxColumn))
+				|| Room.MinRow > Room.MaxRow || Room.MinColumn > Room.MaxColumn || Room.GetRowsNum() > MAX_uint16 || Room.GetColumnsNum() > MAX_uint16)
+			{
+				Ar.SetError();
+				return;
+			}
+			GeneratedRooms.Add(Room);
+		}
+	}
 
-	//Get nearby tile for each direction.
-	//Store a wall location if:
-	//The nearby tile isn't occupied OR
-	//The nearby tile is out of bounds from the tilemap (means we're on the edge of the tiles)
-	if ((GetUpTile(CenterTile, NearbyTile) && !IsTileOccupied(NearbyTile))
-		|| !GetUpTile(CenterTile, NearbyTile))
+	int32 PortalsNum = BorderPortals.Num();
+	Ar << PortalsNum;
+	if (Ar.IsLoading())
 	{
-		FVector WallLocation = FloorCenter - FVector(TileSize / 2.f, 0.f, 0.f);
-		WallSpawnPoints.Add(FWallSpawnPoint(WallLocation));
+		//At most one portal per edge tile
+		if (Ar.IsError() || PortalsNum < 0 || PortalsNum > 2 * (RowsNum + ColumnsNum))
+		{
+			Ar.SetError();
+			return;
+		}
+		BorderPortals.SetNum(PortalsNum);
 	}
-	if ((GetRightTile(CenterTile, NearbyTile) && !IsTileOccupied(NearbyTile))
-		|| !GetRightTile(CenterTile, NearbyTile))
+	for (int32 i = 0; i < PortalsNum; i++)
 	{
-		FVector WallLocation = FloorCenter + FVector(0.f, TileSize / 2.f, 0.f);
-		WallSpawnPoints.Add(FWallSpawnPoint(WallLocation, false));
+		Ar << BorderPortals[i].Key;
+		Ar << BorderPortals[i].Value;
+		if (Ar.IsLoading() && (Ar.IsError() || !IsTileInMap(BorderPortals[i])))
+		{
+			Ar.SetError();
+			return;
+		}
 	}
-	if ((GetDownTile(CenterTile, NearbyTile) && !IsTileOccupied(NearbyTile))
-		|| !GetDownTile(CenterTile, NearbyTile))
+
+	int32 ConnectionsNum = RoomConnections.Num();
+	Ar << ConnectionsNum;
+	if (Ar.IsLoading())
 	{
-		FVector WallLocation = FloorCenter + FVector(TileSize / 2.f, 0.f, 0.f);
-		WallSpawnPoints.Add(FWallSpawnPoint(WallLocation));
+		if (Ar.IsError() || ConnectionsNum < 0 || int64(ConnectionsNum) > int64(RoomsNum) * RoomsNum)
+		{
+			Ar.SetError();
+			return;
+		}
+		RoomConnections.SetNum(ConnectionsNum);
 	}
-	if ((GetLeftTile(CenterTile, NearbyTile) && !IsTileOccupied(NearbyTile))
-		|| !GetLeftTile(CenterTile, NearbyTile))
+	for (int32 i = 0; i < ConnectionsNum; i++)
 	{
-		FVector WallLocation = FloorCenter - FVector(0.f, TileSize / 2.f, 0.f);
-		WallSpawnPoints.Add(FWallSpawnPoint(WallLocation, false));
+		Ar << RoomConnections[i];
+		if (Ar.IsLoading() && (Ar.IsError() || GetPackedFirst(RoomConnections[i]) < 0 || GetPackedFirst(RoomConnections[i]) >= RoomsNum
+			|| GetPackedSecond(RoomConnections[i]) < 0 || GetPackedSecond(RoomConnections[i]) >= RoomsNum))
+		{
+			Ar.SetError();
+			return;
+		}
 	}
 
-	return WallSpawnPoints;
-}
-
-void FTileMatrix::OccupyTile(const Tile& InTile)
-{
-	TileMap[InTile.Key][InTile.Value] = true;
+	if (Ar.IsLoading())
+	{
+		RebuildTileCosts();
+		RebuildTileLabels();
+		RebuildLayoutGraph();
+	}
 }
 
-bool FTileMatrix::CreateUpperRightRoomExpansion(const Tile& StartTile, int32 ExpansionCount, TArray<Tile>& RoomTiles) const
+void FTileMatrix::RebuildTileCosts()
 {
-	RoomTiles.Empty();
-	Tile NewTile = Tile(StartTile.Key + 1, StartTile.Value);
+	TileCosts.Init(RoutingCosts.EmptyTileCost, FMath::Max(RowsNum, 0) * FMath::Max(ColumnsNum, 0));
 
-	for (int32 i = 0; i < ExpansionCount; i++)
+	for (int32 i = 0; i < RowsNum; i++)
 	{
-		//We're moving up so decrement the key
-		//NewTile.Key -= i;
-		NewTile.Key--;
-		NewTile.Value = StartTile.Value;
+		for (int32 j = 0; j < ColumnsNum; j++)
+		{
+			if (TileMap.Get(i, j))
+			{
+				TileCosts[i * ColumnsNum + j] = RoutingCosts.CorridorTileCost;
+			}
+		}
+	}
 
-		for (int32 j = 0; j < ExpansionCount; j++)
+	for (int32 i = 0; i < GeneratedRooms.Num(); i++)
+	{
+		const FRoomRect Room = GeneratedRooms.Get(i);
+		for (int32 Row = Room.MinRow; Row <= Room.MaxRow; Row++)
 		{
-			//Moving right so increment the value
-			NewTile.Value--;
-			RoomTiles.Add(NewTile);
+			for (int32 Column = Room.MinColumn; Column <= Room.MaxColumn; Column++)
+			{
+				TileCosts[Row * ColumnsNum + Column] = RoutingCosts.RoomTileCost;
+			}
 		}
 	}
-	return AreTilesValid(RoomTiles);
 }
 
-bool FTileMatrix::CreateLowerRightRoomExpansion(const Tile& StartTile, int32 ExpansionCount, TArray<Tile>& RoomTiles) const
+void FTileMatrix::RebuildTileLabels()
 {
-	RoomTiles.Empty();
-	Tile NewTile = Tile(StartTile.Key - 1, StartTile.Value);
+	TileLabels.Init(EmptyTileLabel, FMath::Max(RowsNum, 0) * FMath::Max(ColumnsNum, 0));
+
+	for (int32 i = 0; i < RowsNum; i++)
+	{
+		for (int32 j = 0; j < ColumnsNum; j++)
+		{
+			if (TileMap.Get(i, j))
+			{
+				TileLabels[i * ColumnsNum + j] = CorridorLabelFlag;
+			}
+		}
+	}
 
-	for (int32 i = 0; i < ExpansionCount; i++)
+	for (int32 i = 0; i < GeneratedRooms.Num() && i < MaxRoomsNum; i++)
 	{
-		//We're moving down so increment the key
-		NewTile.Key++;
-		NewTile.Value = StartTile.Value;
-		for (int32 j = 0; j < ExpansionCount; j++)
+		const FRoomRect Room = GeneratedRooms.Get(i);
+		for (int32 Row = Room.MinRow; Row <= Room.MaxRow; Row++)
 		{
-			//Moving right so increment the value
-			NewTile.Value++;
-			RoomTiles.Add(NewTile);
+			for (int32 Column = Room.MinColumn; Column <= Room.MaxColumn; Column++)
+			{
+				TileLabels[Row * ColumnsNum + Column] = static_cast<uint16>(i + 1);
+			}
 		}
 	}
-	return AreTilesValid(RoomTiles);
 }
 
-bool FTileMatrix::CreateUpperLeftRoomExpansion(const Tile& StartTile, int32 ExpansionCount, TArray<Tile>& RoomTiles) const
+/**
+ * Sorts & deduplicates (Group, Member) pairs and writes the members of each group as a contiguous slice
+ * @param Pairs - the packed pairs. Sorted in place
+ * @param GroupsNum - the number of groups
+ * @param OutMembers - the members of every group, one slice after the other
+ * @param SetSlice - called with each group, the first member of its slice and its members count
+ */
+static void BuildSlices(TArray<int64>& Pairs, int32 GroupsNum, TArray<int32>& OutMembers, TFunctionRef<void(int32, int32, int32)> SetSlice)
 {
-	RoomTiles.Empty();
-	Tile NewTile = Tile(StartTile.Key - 1, StartTile.Value);
+	Pairs.Sort();
 
-	for (int32 i = 0; i < ExpansionCount; i++)
+	OutMembers.Reset(Pairs.Num());
+	int32 PairIndex = 0;
+	for (int32 Group = 0; Group < GroupsNum; Group++)
 	{
-		//We're moving up so increment the key
-		NewTile.Key++;
-		NewTile.Value = StartTile.Value;
-		for (int32 j = 0; j < ExpansionCount; j++)
+		const int32 FirstMember = OutMembers.Num();
+		for (; PairIndex < Pairs.Num() && GetPackedFirst(Pairs[PairIndex]) == Group; PairIndex++)
 		{
-			//Moving left so decrement the value
-			NewTile.Value--;
-			RoomTiles.Add(NewTile);
+			if (PairIndex == 0 || Pairs[PairIndex] != Pairs[PairIndex - 1])
+			{
+				OutMembers.Add(GetPackedSecond(Pairs[PairIndex]));
+			}
 		}
+		SetSlice(Group, FirstMember, OutMembers.Num() - FirstMember);
 	}
-	return AreTilesValid(RoomTiles);
 }
 
-bool FTileMatrix::CreateLowerLeftRoomExpansion(const Tile& StartTile, int32 ExpansionCount, TArray<Tile>& RoomTiles) const
+void FTileMatrix::RebuildLayoutGraph()
 {
-	RoomTiles.Empty();
-	Tile NewTile = Tile(StartTile.Key + 1, StartTile.Value);
+	static constexpr uint16 MaxCorridorIndex = CorridorLabelFlag - 2;
+	static constexpr uint16 UnassignedCorridorLabel = CorridorLabelFlag | (CorridorLabelFlag - 1);
 
-	for (int32 i = 0; i < ExpansionCount; i++)
+	//Corridors: flood fill every group of corridor tiles that hasn't been assigned an index yet
+	CorridorInfos.Reset();
+	for (int32 i = 0; i < TileLabels.Num(); i++)
 	{
-		//We're moving down so decrement the key
-		NewTile.Key--;
-		NewTile.Value = StartTile.Value;
-
-		for (int32 j = 0; j < ExpansionCount; j++)
+		if (TileLabels[i] & CorridorLabelFlag)
 		{
-			//Moving left so decrement the value
-			NewTile.Value--;
-			RoomTiles.Add(NewTile);
+			TileLabels[i] = UnassignedCorridorLabel;
 		}
 	}
 
-	return AreTilesValid(RoomTiles);
-}
-
-bool FTileMatrix::CanPlaceRoomInTileMap(Tile InTile, int32 RoomSize, TArray<Tile>& TilesToOccupy) const
-{
-	TilesToOccupy.Empty();
-	if (!IsTileOccupied(InTile))
+	TArray<int32> Stack;
+	for (int32 i = 0; i < TileLabels.Num(); i++)
 	{
-		if (CreateUpperRightRoomExpansion(InTile, RoomSize, TilesToOccupy))
+		if (TileLabels[i] != UnassignedCorridorLabel)
 		{
-			return true;
+			continue;
 		}
-		else if (CreateLowerRightRoomExpansion(InTile, RoomSize, TilesToOccupy))
+
+		//Groups past the label limit share the last index
+		if (CorridorInfos.Num() == MaxCorridorIndex)
 		{
-			return true;
+			UE_LOG(TileMatrixLog, Warning, TEXT("More than %d corridor groups. The rest of the corridors share the last corridor index"), MaxCorridorIndex);
 		}
-		else if (CreateUpperLeftRoomExpansion(InTile, RoomSize, TilesToOccupy))
+		const uint16 CorridorIndex = static_cast<uint16>(FMath::Min(CorridorInfos.Num(), int32(MaxCorridorIndex)));
+		const uint16 CorridorLabel = CorridorLabelFlag | CorridorIndex;
+		if (CorridorIndex == CorridorInfos.Num())
 		{
-			return true;
+			CorridorInfos.AddDefaulted();
 		}
-		else if (CreateLowerLeftRoomExpansion(InTile, RoomSize, TilesToOccupy))
+		FCorridorLayoutInfo& Corridor = CorridorInfos[CorridorIndex];
+
+		TileLabels[i] = CorridorLabel;
+		Stack.Add(i);
+		while (Stack.Num() > 0)
 		{
-			return true;
+			const int32 TileIndex = Stack.Pop();
+			const int32 Row = TileIndex / ColumnsNum;
+			const int32 Column = TileIndex % ColumnsNum;
+			Corridor.TilesNum++;
+
+			const int32 NearbyTiles[4] = { Row > 0 ? TileIndex - ColumnsNum : INDEX_NONE, Column + 1 < ColumnsNum ? TileIndex + 1 : INDEX_NONE,
+				Column > 0 ? TileIndex - 1 : INDEX_NONE, Row + 1 < RowsNum ? TileIndex + ColumnsNum : INDEX_NONE };
+			for (int32 k = 0; k < 4; k++)
+			{
+				if (NearbyTiles[k] != INDEX_NONE && TileLabels[NearbyTiles[k]] == UnassignedCorridorLabel)
+				{
+					TileLabels[NearbyTiles[k]] = CorridorLabel;
+					Stack.Add(NearbyTiles[k]);
+				}
+			}
 		}
 	}
-	return false;
-}
 
-void FTileMatrix::CreateRooms(int32 RoomCount)
-{
-	GeneratedRooms.Empty();
-	for (int32 i = 0; i < RoomCount; i++)
+	//Rooms: a room tile is a door when a nearby tile belongs to a corridor or another room
+	const int32 RoomsNum = FMath::Min(GeneratedRooms.Num(), MaxRoomsNum);
+	RoomInfos.Reset();
+	RoomInfos.SetNum(RoomsNum);
+	RoomDoorTiles.Reset();
+
+	TArray<int64> RoomPairs;
+	TArray<int64> CorridorRoomPairs;
+	for (int32 i = 0; i < RoomsNum; i++)
 	{
-		bool bGeneratedRandomRoom = false;
+		const FRoomRect Room = GeneratedRooms.Get(i);
+		FRoomLayoutInfo& RoomInfo = RoomInfos[i];
+		RoomInfo.MinRow = Room.MinRow;
+		RoomInfo.MinColumn = Room.MinColumn;
+		RoomInfo.MaxRow = Room.MaxRow;
+		RoomInfo.MaxColumn = Room.MaxColumn;
+		RoomInfo.TilesNum = Room.GetTilesNum();
+		RoomInfo.FirstDoorTile = RoomDoorTiles.Num();
 
-		for (int32 j = 0; j < MaxRandomAttemptsPerRoom && !bGeneratedRandomRoom; j++)
+		//Only the tiles on the edge of the room have nearby tiles outside of it
+		for (int32 Row = Room.MinRow; Row <= Room.MaxRow; Row++)
 		{
-			int32 RoomSize = FMath::RandRange(MinRoomSize, MaxRoomSize);
-			Tile RandomTile = GetRandomTile();
-			TArray<Tile> RoomTiles;
-
-			if (CanPlaceRoomInTileMap(RandomTile, RoomSize, RoomTiles))
+			//Inner rows only have the first & last column on the edge
+			const int32 ColumnStep = (Row == Room.MinRow || Row == Room.MaxRow) ? 1 : FMath::Max(Room.MaxColumn - Room.MinColumn, 1);
+			for (int32 Column = Room.MinColumn; Column <= Room.MaxColumn; Column += ColumnStep)
 			{
-				//Occupy tiles
-				for (int32 k = 0; k < RoomTiles.Num(); k++)
+				const int32 TileIndex = Row * ColumnsNum + Column;
+
+				const int32 NearbyTiles[4] = { Row > 0 ? TileIndex - ColumnsNum : INDEX_NONE, Column + 1 < ColumnsNum ? TileIndex + 1 : INDEX_NONE,
+					Column > 0 ? TileIndex - 1 : INDEX_NONE, Row + 1 < RowsNum ? TileIndex + ColumnsNum : INDEX_NONE };
+				bool bIsDoor = false;
+				for (int32 k = 0; k < 4; k++)
+				{
+					const uint16 NearbyLabel = NearbyTiles[k] != INDEX_NONE ? TileLabels[NearbyTiles[k]] : EmptyTileLabel;
+					if (NearbyLabel == EmptyTileLabel || GetLabelRoom(NearbyLabel) == i)
+					{
+						continue;
+					}
+
+					bIsDoor = true;
+					if (NearbyLabel & CorridorLabelFlag)
+					{
+						CorridorRoomPairs.Add(PackIndexPair(GetLabelCorridor(NearbyLabel), i));
+					}
+					else
+					{
+						RoomPairs.Add(PackIndexPair(i, GetLabelRoom(NearbyLabel)));
+					}
+				}
+
+				if (bIsDoor)
 				{
-					OccupyTile(RoomTiles[k]);
+					RoomDoorTiles.Add(TileIndex);
 				}
-				StoreGeneratedRoom(FRoomTileCollection(RoomTiles));
-				bGeneratedRandomRoom = true;
 			}
 		}
 
+		RoomInfo.DoorTilesNum = RoomDoorTiles.Num() - RoomInfo.FirstDoorTile;
 	}
-	//PrintDebugTileMap();
-}
 
-void FTileMatrix::PrintDebugTileMap() const
-{
-	UE_LOG(TileMatrixLog, Warning, TEXT(" ---- Printing Debug Tile Map ---- "));
-	//GLog->Log(" ---- Printing Debug Tile Map ---- ");
-	for (int32 i = 0; i < TileMap.Num(); i++)
+	//Neighbors are the rooms that touch each other plus the rooms that got connected by a corridor
+	for (int32 i = 0; i < RoomConnections.Num(); i++)
 	{
-		FString Row;
-		for (int32 j = 0; j < TileMap[i].Num() - 1; j++)
+		const int32 RoomA = GetPackedFirst(RoomConnections[i]);
+		const int32 RoomB = GetPackedSecond(RoomConnections[i]);
+		if (RoomA < RoomsNum && RoomB < RoomsNum)
 		{
-			FString ElementStr = ((TileMap[i])[j]) ? FString("1") : FString("0");
-			ElementStr.Append(" - ");
-			Row.Append(ElementStr);
+			RoomPairs.Add(PackIndexPair(RoomA, RoomB));
+			RoomPairs.Add(PackIndexPair(RoomB, RoomA));
 		}
-		FString ElementStr = ((TileMap[i])[TileMap[i].Num() - 1]) ? FString("1") : FString("0");
-		Row.Append(ElementStr);
-		
-		//GLog->Log(Row);
-		UE_LOG(TileMatrixLog, Warning, TEXT("%s"), *FString(Row));
 	}
 
-	UE_LOG(TileMatrixLog, Warning, TEXT(" ---- End Of Printing Debug Tile Map ----"));
-	//GLog->Log(" ---- End Of Printing Debug Tile Map ----");
+	BuildSlices(RoomPairs, RoomsNum, RoomNeighbors, [this](int32 Room, int32 FirstNeighbor, int32 NeighborsNum)
+	{
+		RoomInfos[Room].FirstNeighbor = FirstNeighbor;
+		RoomInfos[Room].NeighborsNum = NeighborsNum;
+	});
+
+	BuildSlices(CorridorRoomPairs, CorridorInfos.Num(), CorridorRooms, [this](int32 Corridor, int32 FirstRoom, int32 CorridorRoomsNum)
+	{
+		CorridorInfos[Corridor].FirstRoom = FirstRoom;
+		CorridorInfos[Corridor].RoomsNum = CorridorRoomsNum;
+	});
 }
 
-void FTileMatrix::ProjectTileMapLocationsToWorld(float TileSize, TArray<FVector>& FloorLocations, TArray<FWallSpawnPoint>& WallLocations)
+SIZE_T FTileMatrix::GetAllocatedSize() const
+{
+	return TileMap.GetAllocatedSize() + OccupancyCounts.GetAllocatedSize() + TileCosts.GetAllocatedSize()
+		+ CorridorRouter.GetAllocatedSize() + RoutedPath.GetAllocatedSize() + GeneratedRooms.GetAllocatedSize()
+		+ TileLabels.GetAllocatedSize() + RoomConnections.GetAllocatedSize() + RoomInfos.GetAllocatedSize() + RoomDoorTiles.GetAllocatedSize()
+		+ RoomNeighbors.GetAllocatedSize() + CorridorInfos.GetAllocatedSize() + CorridorRooms.GetAllocatedSize();
+}
+
+void FTileMatrix::ProjectTileMapLocationsToWorld(float TileSize, TArray<FFloorSpawnPoint>& FloorLocations, TArray<FWallSpawnPoint>& WallLocations)
 {
 	FloorLocations.Empty();
 	WallLocations.Empty();
 
-	for (int32 i = 0; i < TileMap.Num(); i++)
-	{
-		for (int32 j = 0; j < TileMap[i].Num(); j++)
-		{
-			Tile CurrentTile = Tile(i, j);
-			if (IsTileOccupied(CurrentTile))
-			{
-				FVector FloorCenter = FVector(i * TileSize, j * TileSize, 0);
-				FloorLocations.Add(FloorCenter);
+	ProjectTileGroup(TileMap, 0, 0, TileSize, true, FloorLocations, WallLocations);
+}
 
-				TArray<FWallSpawnPoint> WallSpawnPoints = GenerateWallSpawnPointsFromNearbyTiles(CurrentTile, TileSize);
-				for (int32 k = 0; k < WallSpawnPoints.Num(); k++)
-				{
-					WallLocations.Add(WallSpawnPoints[k]);
-				}
-			}
-		}
+/**
+ * Copies the locations of single tile floor spawn points
+ */
+static void CopyFloorWorldLocations(const TArray<FTileMatrix::FFloorSpawnPoint>& FloorSpawnPoints, TArray<FVector>& OutLocations)
+{
+	OutLocations.Reset(FloorSpawnPoints.Num());
+	for (int32 i = 0; i < FloorSpawnPoints.Num(); i++)
+	{
+		OutLocations.Add(FloorSpawnPoints[i].WorldLocation);
 	}
 }
 
+void FTileMatrix::ProjectTileMapLocationsToWorld(float TileSize, TArray<FVector>& FloorLocations, TArray<FWallSpawnPoint>& WallLocations)
+{
+	//Callers of this overload expect a location per tile
+	TGuardValue<bool> MergeFloorsGuard(bMergeFloors, false);
+
+	TArray<FFloorSpawnPoint> FloorSpawnPoints;
+	ProjectTileMapLocationsToWorld(TileSize, FloorSpawnPoints, WallLocations);
+	CopyFloorWorldLocations(FloorSpawnPoints, FloorLocations);
+}
+
 void FTileMatrix::ProjectTileMapLocationsToWorld(float TileSize, TArray<FRoom>& Rooms, TArray<FVector>& CorridorFloorTiles, TArray<FWallSpawnPoint>& CorridorWalls)
 {
-	//Stores the tiles that belong to rooms. If a tile isn't included in this set then it's a generic tile
-	//And should be stored in the CorridorFloorTiles array (same goes with its respective walls)
-	TSet<Tile> RecordedRoomTiles;
+	TGuardValue<bool> MergeFloorsGuard(bMergeFloors, false);
 
-	Rooms.Empty();
-	Rooms.Reserve(GeneratedRooms.Num() - 1);
+	TArray<FFloorSpawnPoint> CorridorFloorSpawnPoints;
+	ProjectTileMapLocationsToWorld(TileSize, Rooms, CorridorFloorSpawnPoints, CorridorWalls);
+	CopyFloorWorldLocations(CorridorFloorSpawnPoints, CorridorFloorTiles);
 
-	//Storing each room's tiles into a separate FRoom element
-	for (int32 i = 0; i < GeneratedRooms.Num(); i++)
+	PRAGMA_DISABLE_DEPRECATION_WARNINGS
+	for (FRoom& Room : Rooms)
 	{
-		FRoom NewRoom;
-		TArray<Tile> RoomTiles = GeneratedRooms[i].OccupiedTiles;
+		CopyFloorWorldLocations(Room.FloorSpawnPoints, Room.FloorTileWorldLocations);
+	}
+	PRAGMA_ENABLE_DEPRECATION_WARNINGS
+}
 
-		for (int32 j = 0; j < RoomTiles.Num(); j++)
-		{
-			Tile CurrentTile = RoomTiles[j];
-			RecordedRoomTiles.Add(CurrentTile); //Mark this tile as visited
+void FTileMatrix::ProjectTileMapLocationsToWorld(float TileSize, TArray<FRoom>& Rooms, TArray<FFloorSpawnPoint>& CorridorFloorTiles, TArray<FWallSpawnPoint>& CorridorWalls)
+{
+	//Tiles that don't belong to a room (see TileLabels) are generic tiles
+	//And should be stored in the CorridorFloorTiles array (same goes with their respective walls)
+	Rooms.Empty();
+	Rooms.SetNum(GeneratedRooms.Num());
 
-			FVector FloorCenter = FVector(CurrentTile.Key * TileSize, CurrentTile.Value * TileSize, 0);
-			NewRoom.FloorTileWorldLocations.Add(FloorCenter);
-			TArray<FWallSpawnPoint> RoomWallSpawnPoints = GenerateWallSpawnPointsFromNearbyTiles(CurrentTile, TileSize);
-			for (int32 k = 0; k < RoomWallSpawnPoints.Num(); k++)
-			{
-				NewRoom.WallSpawnPoints.Add(RoomWallSpawnPoints[k]);
-			}
+	//Storing each room's tiles into a separate FRoom element
+	ParallelFor(GeneratedRooms.Num(), [&](int32 RoomIndex)
+	{
+		const FRoomRect Room = GeneratedRooms.Get(RoomIndex);
+		FTileBitGrid RoomMask(Room.GetRowsNum(), Room.GetColumnsNum());
+		RoomMask.SetRect(0, 0, Room.GetRowsNum() - 1, Room.GetColumnsNum() - 1);
 
-		}
-		Rooms.Add(NewRoom);
-	}
+		ProjectTileGroup(RoomMask, Room.MinRow, Room.MinColumn, TileSize, false, Rooms[RoomIndex].FloorSpawnPoints, Rooms[RoomIndex].WallSpawnPoints);
+	});
 
-	for (int32 i = 0; i < TileMap.Num(); i++)
+	//The corridor tiles are the ones left once the room tiles are cleared. Each block of rows only clears its own words
+	FTileBitGrid CorridorMask = TileMap;
+	ParallelFor(FMath::DivideAndRoundUp(RowsNum, ProjectionBlockSize), [&](int32 BlockIndex)
 	{
-		for (int32 j = 0; j < TileMap[i].Num(); j++)
+		const int32 LastRow = FMath::Min((BlockIndex + 1) * ProjectionBlockSize, RowsNum) - 1;
+		for (int32 i = BlockIndex * ProjectionBlockSize; i <= LastRow; i++)
 		{
-			Tile CurrentTile = Tile(i, j);
-			if (IsTileOccupied(CurrentTile) && !RecordedRoomTiles.Contains(CurrentTile))
+			for (int32 j = 0; j < ColumnsNum; j++)
 			{
-				FVector FloorCenter = FVector(i * TileSize, j * TileSize, 0);
-				CorridorFloorTiles.Add(FloorCenter);
-
-				TArray<FWallSpawnPoint> WallSpawnPoints = GenerateWallSpawnPointsFromNearbyTiles(CurrentTile, TileSize);
-				for (int32 k = 0; k < WallSpawnPoints.Num(); k++)
+				if (GetLabelRoom(TileLabels[i * ColumnsNum + j]) != INDEX_NONE)
 				{
-					CorridorWalls.Add(WallSpawnPoints[k]);
+					CorridorMask.Clear(i, j);
 				}
 			}
 		}
-	}
+	});
+
+	ProjectTileGroup(CorridorMask, 0, 0, TileSize, true, CorridorFloorTiles, CorridorWalls);
 }
@@ -0,0 +1,87 @@
+// Copyright (c) 2022 Orfeas Eleftheriou
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TileBitGrid.h"
+
+/**
+ * A* path finder over a grid of tiles with a per-tile cost field.
+ * All the scratch buffers (open list heap, closed set, scores) are kept between searches
+ * so routing many corridors on the same grid doesn't allocate after the first search
+ */
+class DUNGEONGENERATORPLUGIN_API FCorridorRouter
+{
+public:
+
+	FCorridorRouter();
+
+	/**
+	 * Sizes the scratch buffers for a Rows * Columns grid. Does nothing if the router already matches the grid
+	 */
+	void Init(int32 Rows, int32 Columns);
+
+	/**
+	 * Finds the cheapest 4-connected path between two tiles.
+	 * Tile indices are Row * Columns + Column
+	 * @param StartIndex - the tile to start from
+	 * @param GoalIndex - the tile to reach
+	 * @param TileCosts - the cost of entering each tile. Tiles with a cost of 0 are blocked
+	 * @param HeuristicCost - cost per tile used to estimate the remaining distance. Paths are optimal when it's <= the cheapest tile cost
+	 * @param OutPath - tile indices of the path, from StartIndex to GoalIndex (both included)
+	 * @return true if a path was found
+	 */
+	bool FindPath(int32 StartIndex, int32 GoalIndex, const TArray<uint8>& TileCosts, int32 HeuristicCost, TArray<int32>& OutPath);
+
+	/**
+	 * Returns the number of tiles that were expanded during the last search
+	 */
+	inline int32 GetLastExpandedTilesNum() const { return LastExpandedTilesNum; }
+
+	/**
+	 * Returns the heap memory used by the scratch buffers
+	 */
+	SIZE_T GetAllocatedSize() const;
+
+private:
+
+	struct FOpenNode
+	{
+		/* Cost so far + estimated remaining cost */
+		int32 TotalCost;
+		/* Estimated remaining cost. Used to break ties in favor of nodes closer to the goal */
+		int32 RemainingCost;
+		int32 TileIndex;
+
+		inline bool operator<(const FOpenNode& Other) const
+		{
+			return TotalCost < Other.TotalCost || (TotalCost == Other.TotalCost && RemainingCost < Other.RemainingCost);
+		}
+	};
+
+	int32 RowsNum;
+	int32 ColumnsNum;
+
+	/* Binary min-heap of the open nodes. Only the first OpenNodesNum elements are valid */
+	TArray<FOpenNode> OpenList;
+	int32 OpenNodesNum;
+
+	/* Tiles that have been expanded during the current search */
+	FTileBitGrid ClosedSet;
+
+	/* Cost from the start tile. Only valid for tiles whose VisitStamp matches the SearchStamp */
+	TArray<int32> CostSoFar;
+
+	/* The previous tile on the cheapest known path. Same validity as CostSoFar */
+	TArray<int32> CameFrom;
+
+	/* Avoids clearing CostSoFar & CameFrom on every search */
+	TArray<uint32> VisitStamp;
+	uint32 SearchStamp;
+
+	int32 LastExpandedTilesNum;
+
+	void PushOpenNode(const FOpenNode& Node);
+
+	FOpenNode PopOpenNode();
+};
@@ -0,0 +1,105 @@
+// Copyright (c) 2022 Orfeas Eleftheriou
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "DungeonBenchmarkCommandlet.generated.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(DungeonBenchmarkLog, Log, All);
+
+/**
+ * Times the stages of FTileMatrix (InitTileMap, PlaceRooms, ConnectGeneratedRooms and both ProjectTileMapLocationsToWorld overloads)
+ * over a sweep of map sizes, room sizes and room counts, using fixed seeds so runs on different commits are comparable.
+ * Doesn't spawn anything so it runs headless:
+ *
+ * UnrealEditor-Cmd <Project>.uproject -run=DungeonBenchmark -nullrhi -unattended [options]
+ *
+ * -Sizes=50,100,250       tiles along each side of the square tile maps
+ * -RoomSizes=3-5,5-7      MinRoomSize-MaxRoomSize pairs
+ * -FillRatios=0.1,0.3     fraction of the map to cover with rooms. Converted to a room count from the average room size
+ * -Rooms=100,1000         explicit room counts, swept alongside the fill ratios
+ * -Iterations=3           runs of every configuration
+ * -Seed=1337              seed of every run
+ * -TileSize=100           world size of a tile used by the projections
+ * -Merge                  merges walls & floors during the projections
+ * -Label=abc123           copied into every result (ie the commit the benchmark ran on)
+ * -Output=Path            file path without extension. Defaults to Saved/DungeonBenchmark/Benchmark-<timestamp>
+ * -Format=csv|json|both   defaults to both
+ *
+ * AllocatedBytes & PeakAllocatedBytes are counted from the containers themselves so they're exact and comparable across configurations and commits.
+ * The process figures are only a rough signal: ProcessPeakUsedPhysicalBytes never drops during a sweep, so benchmark a single configuration
+ * per run to compare it. UsedPhysicalDeltaBytes depends on how much memory the allocator kept around from earlier stages
+ */
+UCLASS()
+class DUNGEONGENERATORPLUGIN_API UDungeonBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+
+	UDungeonBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+
+	/**
+	 * A single point of the sweep
+	 */
+	struct FBenchmarkConfig
+	{
+		int32 Size = 0;
+		int32 MinRoomSize = 0;
+		int32 MaxRoomSize = 0;
+
+		/* Negative when the room count was given explicitly */
+		float FillRatio = -1.f;
+
+		int32 RoomsNum = 0;
+	};
+
+	/**
+	 * Measurements of a stage of a configuration across every iteration
+	 */
+	struct FStageResult
+	{
+		FString Stage;
+		double MinMs = MAX_dbl;
+		double MaxMs = 0.0;
+		double TotalMs = 0.0;
+
+		/* Bytes allocated by the tile matrix & the projected locations once the stage is done */
+		uint64 AllocatedBytes = 0;
+
+		/* Largest growth of the process memory during the stage. Memory the allocator kept from earlier stages gets reused without growing it */
+		int64 UsedPhysicalDeltaBytes = 0;
+	};
+
+	struct FConfigResult
+	{
+		FBenchmarkConfig Config;
+		int32 Iterations = 0;
+		int32 RoomsPlaced = 0;
+
+		/* Fraction of the map covered by rooms after placement */
+		float RoomFill = 0.f;
+
+		TArray<FStageResult> Stages;
+
+		/* Largest AllocatedBytes of the stages */
+		uint64 PeakAllocatedBytes = 0;
+
+		/* Peak memory of the process so far, including every earlier configuration of the sweep */
+		uint64 ProcessPeakUsedPhysicalBytes = 0;
+	};
+
+	/**
+	 * Runs every iteration of a configuration
+	 */
+	static FConfigResult RunConfig(const FBenchmarkConfig& Config, int32 Iterations, int32 Seed, float TileSize, bool bMerge);
+
+	static FString ToCsv(const TArray<FConfigResult>& Results, const FString& Label, int32 Seed);
+
+	static FString ToJson(const TArray<FConfigResult>& Results, const FString& Label, int32 Seed);
+};
@@ -0,0 +1,183 @@
+// Copyright (c) 2022 Orfeas Eleftheriou
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DungeonGenerator.h"
+#include "DungeonChunkStreamer.generated.h"
+
+class UHierarchicalInstancedStaticMeshComponent;
+class UPrimitiveComponent;
+
+/**
+ * A spawned (or generating) chunk of a streamed dungeon
+ */
+USTRUCT()
+struct FDungeonChunk
+{
+	GENERATED_BODY()
+
+	/* Instanced (or merged) components holding the floors & walls of the chunk */
+	UPROPERTY()
+	TArray<UPrimitiveComponent*> Components;
+
+	/* True while the chunk is generated in the background */
+	bool bIsGenerating = false;
+
+	/* Matches the request that generated the chunk. Results of older requests are dropped */
+	uint32 RequestId = 0;
+};
+
+/**
+ * Generates an endless dungeon in chunks around a tracked actor.
+ * Every chunk is a TileMapRows * TileMapColumns tile map generated from the WorldSeed and its chunk coordinate so the same chunk always gets the same layout.
+ * Neighbor chunks agree on a portal tile on their shared edge and each chunk connects its portals to its rooms so corridors continue across chunks.
+ * Chunks are spawned as instanced meshes (or a single merged mesh with EDungeonSpawnMode::MergedMeshes) using FloorSM & WallSM
+ * and despawned once the tracked actor moves away, so memory & instance counts stay bounded
+ */
+UCLASS()
+class DUNGEONGENERATORPLUGIN_API ADungeonChunkStreamer : public ADungeonGenerator
+{
+	GENERATED_BODY()
+
+private:
+
+	/**
+	 * Spawned & generating chunks, by chunk coordinate
+	 */
+	UPROPERTY()
+	TMap<FIntPoint, FDungeonChunk> Chunks;
+
+	FTimerHandle ChunkUpdateTimerHandle;
+
+	/**
+	 * Increased on every chunk request and when streaming stops
+	 */
+	uint32 ChunkRequestId = 0;
+
+	/**
+	 * The tile size used by the chunks that are currently spawned
+	 */
+	float ChunkTileSize = 0.f;
+
+	/**
+	 * Requests the missing chunks around the tracked actor and despawns the chunks that are too far
+	 */
+	void UpdateChunks();
+
+	/**
+	 * Generates a chunk in the background and spawns it once ready
+	 */
+	void RequestChunk(const FIntPoint& ChunkCoordinate);
+
+	/**
+	 * Spawns the floors & walls of a generated chunk
+	 * @param ChunkCoordinate - the chunk to spawn
+	 * @param FloorTileLocations - the floor tiles of the chunk, relative to the chunk origin
+	 * @param WallSpawnPoints - the walls of the chunk, relative to the chunk origin
+	 */
+	void SpawnChunk(const FIntPoint& ChunkCoordinate, const TArray<FTileMatrix::FFloorSpawnPoint>& FloorTileLocations, const TArray<FTileMatrix::FWallSpawnPoint>& WallSpawnPoints);
+
+	/**
+	 * Destroys the components of a chunk
+	 */
+	void DespawnChunk(FDungeonChunk& Chunk);
+
+	/**
+	 * Creates an instanced component for a chunk
+	 */
+	UHierarchicalInstancedStaticMeshComponent* CreateChunkComponent(UStaticMesh* SMToSpawn);
+
+	/**
+	 * Returns the world location of the first tile of a chunk
+	 */
+	FVector GetChunkOrigin(const FIntPoint& ChunkCoordinate) const;
+
+	/**
+	 * Returns the chunk that contains a world location
+	 */
+	FIntPoint GetChunkAt(const FVector& WorldLocation) const;
+
+	/**
+	 * Returns the location the chunks are streamed around
+	 */
+	FVector GetTrackedLocation() const;
+
+	/**
+	 * Returns the portal index along the shared edge of two chunks. Both chunks compute the same value
+	 * @param ChunkCoordinate - the chunk with the lower coordinate of the two
+	 * @param Axis - 0 for the edge towards ChunkCoordinate + (1, 0), 1 for the edge towards ChunkCoordinate + (0, 1)
+	 * @param EdgeLength - the number of tiles along the edge
+	 */
+	int32 GetEdgePortal(const FIntPoint& ChunkCoordinate, int32 Axis, int32 EdgeLength) const;
+
+protected:
+
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+public:
+
+	ADungeonChunkStreamer();
+
+	/**
+	 * Seed of the whole world. Each chunk is generated from this seed and its chunk coordinate
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chunk Streaming")
+	int32 WorldSeed = 0;
+
+	/**
+	 * Chunks up to this many chunks away from the chunk of the tracked actor are spawned
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chunk Streaming", meta = (ClampMin = 0))
+	int32 ChunkStreamingRadius = 2;
+
+	/**
+	 * Chunks are only despawned once they're this many chunks past the ChunkStreamingRadius.
+	 * Avoids respawning the same chunks while the tracked actor walks back and forth over a chunk border
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chunk Streaming", meta = (ClampMin = 0))
+	int32 ChunkDespawnMargin = 1;
+
+	/**
+	 * Seconds between checks of the tracked actor's location
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chunk Streaming", meta = (ClampMin = 0.01))
+	float ChunkUpdateInterval = 0.25f;
+
+	/**
+	 * The actor to stream the chunks around. If not assigned, the player pawn is used
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chunk Streaming")
+	AActor* TrackedActor = nullptr;
+
+	/**
+	 * If true, streaming starts on BeginPlay
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chunk Streaming")
+	bool bStreamOnBeginPlay = true;
+
+	/**
+	 * Starts spawning chunks around the tracked actor
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Chunk Streaming")
+	void StartStreaming();
+
+	/**
+	 * Stops streaming and despawns every chunk
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Chunk Streaming")
+	void StopStreaming();
+
+	/**
+	 * Returns the number of spawned chunks
+	 */
+	UFUNCTION(BlueprintPure, Category = "Chunk Streaming")
+	int32 GetSpawnedChunksNum() const;
+
+	/**
+	 * Returns the seed a chunk is generated from
+	 */
+	static int32 GetChunkSeed(int32 InWorldSeed, const FIntPoint& ChunkCoordinate);
+};
@@ -13,16 +13,175 @@ DECLARE_LOG_CATEGORY_EXTERN(DungeonGenerator, Log, All);
 class AStaticMeshActor;
 class UStaticMesh;
 class UMaterialInterface;
+class UHierarchicalInstancedStaticMeshComponent;
+class UProceduralMeshComponent;
+class FDungeonMeshMerger;
+struct FStreamableHandle;
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnDungeonSpawned);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnDungeonSpawnProgress, int32, SpawnedMeshes, int32, TotalMeshes);
 
+/**
+ * Shapes of the corridors that connect the rooms. Mirrors FTileMatrix::ECorridorStyle
+ */
+UENUM(BlueprintType)
+enum class EDungeonCorridorStyle : uint8
+{
+	/* Same corridors as previous versions of the generator */
+	Greedy,
+	/* Single bend corridors */
+	LShaped,
+	/* Corridors that bend twice, halfway between the rooms */
+	ZShaped,
+	/* Corridors that go around rooms and merge with existing corridors */
+	Routed
+};
+
+/**
+ * How rooms get connected to each other. Mirrors FTileMatrix::ERoomConnectivity
+ */
+UENUM(BlueprintType)
+enum class EDungeonRoomConnectivity : uint8
+{
+	/* Same as previous versions of the generator. Each room connects to the previously generated room */
+	Chain,
+	/* Rooms connect to their nearest rooms along a minimum spanning tree, plus a few extra connections */
+	MinimumSpanningTree
+};
+
+/**
+ * How the generator turns floor tiles and walls into meshes
+ */
+UENUM(BlueprintType)
+enum class EDungeonSpawnMode : uint8
+{
+	/* A static mesh actor for each floor tile and wall */
+	Actors,
+	/* Instances of hierarchical instanced static mesh components owned by the generator, one component per mesh & material */
+	InstancedMeshes,
+	/**
+	 * Procedural meshes owned by the generator with the floors & walls baked in. One mesh per room and one per MergedMeshCellSize cell of corridors.
+	 * The floor & wall meshes need "Allow CPU Access" in packaged builds
+	 */
+	MergedMeshes
+};
+
+/**
+ * Everything a client needs to generate the same dungeon as the server
+ */
+USTRUCT(BlueprintType)
+struct FDungeonGenerationDescriptor
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Generation Descriptor")
+	int32 Seed = 0;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Generation Descriptor")
+	int32 TileMapRows = 0;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Generation Descriptor")
+	int32 TileMapColumns = 0;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Generation Descriptor")
+	int32 MinRoomSize = 0;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Generation Descriptor")
+	int32 MaxRoomSize = 0;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Generation Descriptor")
+	int32 RoomsToGenerate = 0;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Generation Descriptor")
+	int32 MaxRandomAttemptsPerRoom = 0;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Generation Descriptor")
+	bool bUseFreeSpaceIndex = true;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Generation Descriptor")
+	EDungeonCorridorStyle CorridorStyle = EDungeonCorridorStyle::Greedy;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Generation Descriptor")
+	EDungeonRoomConnectivity RoomConnectivity = EDungeonRoomConnectivity::MinimumSpanningTree;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Generation Descriptor")
+	float ExtraConnectionsRatio = 0.f;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Generation Descriptor")
+	int32 ConnectionCandidatesPerRoom = 0;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Generation Descriptor")
+	UDataTable* RoomTemplatesDataTable = nullptr;
+
+	/**
+	 * GetLayoutHash of the server's tile matrix. Clients compare their own layout against it
+	 */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Generation Descriptor")
+	int32 LayoutHash = 0;
+
+	/**
+	 * Increased by the server on every generation so clients regenerate even if nothing else changed
+	 */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Generation Descriptor")
+	int32 GenerationCount = 0;
+};
+
+/**
+ * Everything a generator spawned for one room (or for the corridors). Lets the generator tear down its own meshes without searching the world
+ */
+USTRUCT()
+struct FDungeonSpawnedGroup
+{
+	GENERATED_BODY()
+
+	/* Spawned by EDungeonSpawnMode::Actors */
+	UPROPERTY()
+	TArray<AStaticMeshActor*> Actors;
+
+	/* Created by EDungeonSpawnMode::MergedMeshes */
+	UPROPERTY()
+	TArray<UProceduralMeshComponent*> MergedMeshComponents;
+};
+
+/**
+ * Counters of the mesh actor pool (see ADungeonGenerator::bPoolMeshActors)
+ */
+USTRUCT(BlueprintType)
+struct FDungeonMeshPoolStats
+{
+	GENERATED_BODY()
+
+	/* Meshes that reused a pooled actor */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Mesh Pool Stats")
+	int32 Hits = 0;
+
+	/* Meshes that had to spawn a new actor */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Mesh Pool Stats")
+	int32 Misses = 0;
+
+	/* Actors that got hidden & returned to the pool instead of being destroyed */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Mesh Pool Stats")
+	int32 Released = 0;
+
+	/* Actors that got destroyed because the pool was full or got trimmed */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Mesh Pool Stats")
+	int32 Destroyed = 0;
+
+	/* Actors currently waiting in the pool */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Mesh Pool Stats")
+	int32 PooledActorsNum = 0;
+};
+
+/**
+ * Meshes & materials are soft references so only the templates a dungeon actually uses get loaded (see ADungeonGenerator::SpawnDungeon)
+ */
 USTRUCT(BlueprintType)
 struct FRoomTemplate : public FTableRowBase
 {
 	GENERATED_BODY()
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "RoomTemplate")
-	UStaticMesh* RoomTileMesh;
+	TSoftObjectPtr<UStaticMesh> RoomTileMesh;
 
 	/**
 	 * If assigned, we're going to replace the default material of the RoomTileMesh with the given mat
@@ -30,7 +189,7 @@ struct FRoomTemplate : public FTableRowBase
 	 * Useful in cases where you want the same static mesh but with different material variations as room templates
 	 */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category= "RoomTemplate")
-	UMaterialInterface* RoomTileMeshMaterialOverride;
+	TSoftObjectPtr<UMaterialInterface> RoomTileMeshMaterialOverride;
 
 	/**
 	 * Same functionality as FloorPivotOffset - check comments in Source Code or In-Editor Details Panel!
@@ -39,14 +198,14 @@ struct FRoomTemplate : public FTableRowBase
 	FVector RoomTilePivotOffset;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "RoomTemplate")
-	UStaticMesh* WallMesh;
+	TSoftObjectPtr<UStaticMesh> WallMesh;
 
 	/**
 	 * Used to replace default material of WallMesh
 	 * Check RoomTileMeshMaterialOverride docs for more info
 	 */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "RoomTemplate")
-	UMaterialInterface* WallMeshMaterialOverride;
+	TSoftObjectPtr<UMaterialInterface> WallMeshMaterialOverride;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "RoomTemplate")
 	FVector WallMeshPivotOffset;
@@ -68,17 +227,141 @@ private:
 	 */
 	FTileMatrix TileMatrix;
 
+	/**
+	 * The tile size the TileMatrix was projected with. Converts world locations to tiles for the layout queries
+	 */
+	float GeneratedTileSize = 0.f;
+
+	/**
+	 * World locations projected from the tile matrix, ready to be spawned
+	 */
+	struct FDungeonSpawnData
+	{
+		/* Only used when spawning from the RoomTemplatesDataTable */
+		TArray<FTileMatrix::FRoom> Rooms;
+
+		/* Floor tiles that don't belong to Rooms (ie every floor tile for generic dungeons and the corridor tiles otherwise) */
+		TArray<FTileMatrix::FFloorSpawnPoint> FloorTileLocations;
+
+		/* Walls that don't belong to Rooms */
+		TArray<FTileMatrix::FWallSpawnPoint> WallSpawnPoints;
+	};
+
+	/**
+	 * Raised to cancel the background generation that is currently in flight. Shared with the worker thread
+	 */
+	TSharedPtr<std::atomic<bool>, ESPMode::ThreadSafe> AsyncGenerationCancellationFlag;
+
+	/**
+	 * Increased on every generation request. Background results & template loads with an older id are discarded
+	 */
+	uint32 GenerationId = 0;
+
+	/**
+	 * Transforms of the meshes that share the same mesh & material and are waiting to be spawned
+	 */
+	struct FDungeonMeshBatch
+	{
+		UStaticMesh* Mesh;
+		UMaterialInterface* MaterialOverride;
+
+		/* The room the meshes belong to, or INDEX_NONE. Keeps the meshes of a room together in the spawn order */
+		int32 SpawnGroup;
+
+		TArray<FTransform> Transforms;
+	};
+
+	/**
+	 * A slice of a batch that is spawned in one go. The spawn order is decided per chunk
+	 */
+	struct FDungeonSpawnChunk
+	{
+		int32 BatchIndex;
+		int32 FirstTransform;
+		int32 TransformsNum;
+
+		/* Squared distance of the closest transform of the chunk to the viewer */
+		double DistanceSquared;
+	};
+
+	/**
+	 * Max transforms of a spawn chunk
+	 */
+	static constexpr int32 SpawnChunkSize = 64;
+
+	/**
+	 * Meshes queued by the spawn functions. Emptied once every mesh has been spawned
+	 */
+	TArray<FDungeonMeshBatch> QueuedMeshBatches;
+
+	/**
+	 * Chunks of QueuedMeshBatches, closest to the viewer first
+	 */
+	TArray<FDungeonSpawnChunk> SpawnChunks;
+
+	/**
+	 * The chunk to continue spawning from and how many of its transforms have been spawned already
+	 */
+	int32 NextSpawnChunk = 0;
+	int32 NextChunkTransform = 0;
+
+	int32 SpawnedMeshesNum = 0;
+	int32 QueuedMeshesNum = 0;
+
+	/**
+	 * Components holding the instances of EDungeonSpawnMode::InstancedMeshes. Kept between generations so they can be reused
+	 */
+	UPROPERTY()
+	TArray<UHierarchicalInstancedStaticMeshComponent*> InstancedMeshComponents;
+
+	/**
+	 * The actors & merged meshes spawned by this generator, by spawn group (the room they belong to or INDEX_NONE for everything else).
+	 * Saved with the generator so meshes generated in the editor can still be destroyed after reloading the level.
+	 * Not duplicated so copies of the generator don't destroy the meshes of the original.
+	 * Still duplicated for PIE since the PIE world gets its own copies of the meshes, which a regeneration has to destroy
+	 */
+	UPROPERTY(NonPIEDuplicateTransient)
+	TMap<int32, FDungeonSpawnedGroup> SpawnedGroups;
+
 	/*void SpawnFloorTiles(const TArray<FVector>& SpawnLocations, UMaterialInterface* MaterialOverride = nullptr);
 
 	void SpawnWallTiles(const TArray<FVector>& SpawnLocations, UMaterialInterface* MaterialOverride = nullptr);*/
 
+	/**
+	 * Hidden mesh actors of previous dungeons, waiting to be reused by SpawnDungeonMesh
+	 */
+	UPROPERTY(Transient)
+	TArray<AStaticMeshActor*> PooledMeshActors;
+
+	FDungeonMeshPoolStats MeshPoolStats;
+
 	/**
 	 * Destroys all previously generated meshes from this dungeon generator
 	 */
 	void DestroyDungeonMeshes();
 
 	/**
-	 * Spawns the assigned floorsm at the given transform
+	 * Destroys the merged meshes of a spawn group and destroys (or pools) its actors
+	 */
+	void DestroySpawnedGroup(FDungeonSpawnedGroup& Group);
+
+	/**
+	 * Returns true if released mesh actors go to the pool. Only game worlds pool actors; hidden actors would end up saved in editor levels
+	 */
+	bool CanPoolMeshActors() const;
+
+	/**
+	 * Hides a mesh actor and adds it to the pool. Destroys it instead if the pool is full
+	 */
+	void ReleaseMeshActor(AStaticMeshActor* SMActor);
+
+	/**
+	 * Destroys pooled actors until at most MaxPooledActors are left
+	 */
+	void TrimMeshActorPool(int32 MaxPooledActors);
+
+	/**
+	 * Spawns the assigned floorsm at the given transform. Reuses a pooled actor if there is one
 	 * @param InTransform - the transform to spawn the mesh at
 	 * @param SMToSpawn - the mesh to spawn
 	 * @param OverrideMaterial - if assigned, we're going to replace the 1st default material of SMToSpawn
@@ -86,12 +369,213 @@ private:
 	 */
 	AStaticMeshActor* SpawnDungeonMesh(const FTransform& InTransform, UStaticMesh* SMToSpawn, UMaterialInterface* OverrideMaterial = nullptr);
 
+	/**
+	 * Queues a mesh to be spawned by SpawnQueuedDungeonMeshes, grouped with the meshes that share the same mesh, material & spawn group
+	 * @param InTransform - the transform to spawn the mesh at
+	 * @param SMToSpawn - the mesh to spawn
+	 * @param OverrideMaterial - if assigned, we're going to replace the 1st default material of SMToSpawn
+	 * @param SpawnGroup - the room the mesh belongs to, if any
+	 */
+	void QueueDungeonMesh(const FTransform& InTransform, UStaticMesh* SMToSpawn, UMaterialInterface* OverrideMaterial = nullptr, int32 SpawnGroup = INDEX_NONE);
+
+	/**
+	 * Orders the queued meshes by their distance to the viewer and starts spawning them.
+	 * During gameplay, with a SpawnFrameBudgetMs the meshes are spawned over multiple frames. Otherwise they're all spawned right away
+	 */
+	void SpawnQueuedDungeonMeshes();
+
+	/**
+	 * Spawns queued meshes until the queue is empty or the budget runs out, but always at least one mesh (or chunk of instances).
+	 * Broadcasts OnDungeonSpawned once the queue is empty
+	 * @param BudgetSeconds - the time we're allowed to spend. Non-positive values drain the whole queue
+	 */
+	void DrainSpawnQueue(double BudgetSeconds);
+
+	/**
+	 * Bakes the queued meshes into procedural meshes, one per room and one per MergedMeshCellSize cell for everything else
+	 */
+	void SpawnMergedDungeonMeshes();
+
+	/**
+	 * Drops anything that hasn't been spawned yet
+	 */
+	void ClearSpawnQueue();
+
+	/**
+	 * Returns the location the closest meshes are spawned around: the player camera, the player pawn or the generator itself
+	 */
+	FVector GetSpawnViewLocation() const;
+
+	/**
+	 * Returns the instanced component that renders the given mesh & material. Creates a new one if needed
+	 * @param SMToSpawn - the mesh of the component
+	 * @param OverrideMaterial - if assigned, replaces the 1st default material of SMToSpawn
+	 */
+	UHierarchicalInstancedStaticMeshComponent* FindOrCreateInstancedMeshComponent(UStaticMesh* SMToSpawn, UMaterialInterface* OverrideMaterial);
+
+	/**
+	 * A row of RoomTemplatesDataTable with everything spawning needs already resolved.
+	 * The asset pointers are only assigned once the assets of the template are loaded (see ResolveRoomTemplate)
+	 */
+	struct FCompiledRoomTemplate
+	{
+		TSoftObjectPtr<UStaticMesh> FloorMeshAsset;
+		TSoftObjectPtr<UMaterialInterface> FloorMaterialOverrideAsset;
+		TSoftObjectPtr<UStaticMesh> WallMeshAsset;
+		TSoftObjectPtr<UMaterialInterface> WallMaterialOverrideAsset;
+
+		UStaticMesh* FloorMesh;
+		UMaterialInterface* FloorMaterialOverride;
+		FVector FloorPivotOffset;
+
+		UStaticMesh* WallMesh;
+		UMaterialInterface* WallMaterialOverride;
+		FVector WallPivotOffset;
+		bool bIsWallFacingX;
+	};
+
+	/**
+	 * The rows of RoomTemplatesDataTable in row order, indexed by template id. Rebuilt when another table gets assigned or the table changes
+	 */
+	TArray<FCompiledRoomTemplate> CompiledRoomTemplates;
+
+	/**
+	 * The table CompiledRoomTemplates was built from
+	 */
+	TWeakObjectPtr<UDataTable> CompiledRoomTemplatesTable;
+
+	/**
+	 * Tile size of the floor mesh of the 1st template
+	 */
+	float CompiledRoomTemplatesTileSize = 0.f;
+
+	/**
+	 * Raised when the rows of CompiledRoomTemplatesTable change
+	 */
+	bool bCompiledRoomTemplatesDirty = true;
+
+	FDelegateHandle RoomTemplatesChangedHandle;
+
+	/**
+	 * Keeps the assets of the templates used by the current dungeon loaded (or tracks their loading). Released with the dungeon
+	 */
+	TSharedPtr<FStreamableHandle> RoomTemplatesLoadHandle;
+
+	/**
+	 * Picks the template of each room from the GenerationSeed
+	 * @param RoomsNum - the number of rooms
+	 * @param OutRoomTemplates - the template id of each room
+	 */
+	void PickRoomTemplates(int32 RoomsNum, TArray<int32>& OutRoomTemplates) const;
+
+	/**
+	 * Assigns the asset pointers of a compiled template from its loaded soft references
+	 */
+	static void ResolveRoomTemplate(FCompiledRoomTemplate& RoomTemplate);
+
+	/**
+	 * Stops loading (and releases) the assets of the room templates
+	 */
+	void ReleaseRoomTemplateAssets();
+
+	/**
+	 * Returns true while the assets of the picked room templates are still loading
+	 */
+	bool IsLoadingRoomTemplates() const;
+
+	/**
+	 * Rebuilds CompiledRoomTemplates if RoomTemplatesDataTable changed since the last build
+	 * @return false if there are no templates or the floor mesh of the 1st template is missing, fails to load or has no size
+	 */
+	bool UpdateCompiledRoomTemplates();
+
+	void OnRoomTemplatesChanged();
+
 	/**
 	 * Checks the bounding box of the mesh and returns its extend along Y axis
 	 * @return the extend along Y axis
 	 */
 	float CalculateFloorTileSize(const UStaticMesh& Mesh) const;
 
+	/**
+	 * Spawns a dungeon using random room templates from a provided data table
+	 * Assumes the data table contains correct values in terms of mesh sizes etc. and that the assets of the picked templates are loaded
+	 * @param RoomTemplates - the template id of each room
+	 * @param Rooms - the floor tiles & walls of each room
+	 * @param CorridorFloorTiles - the floor tiles that don't belong to any room
+	 * @param CorridorWalls - the walls that don't belong to any room
+	 */
+	void SpawnDungeonFromDataTable(const TArray<int32>& RoomTemplates, const TArray<FTileMatrix::FRoom>& Rooms, const TArray<FTileMatrix::FFloorSpawnPoint>& CorridorFloorTiles, const TArray<FTileMatrix::FWallSpawnPoint>& CorridorWalls);
+
+	/**
+	 * Spawns a generic dungeon using the same floor mesh and wall mesh for all the rooms/corridors
+	 * @param FloorTileLocation - the locations for each floor tile
+	 * @param WallSpawnPoints - the spawn points for each wall
+	 */
+	void SpawnGenericDungeon(const TArray<FTileMatrix::FFloorSpawnPoint>& FloorTileLocations, const TArray<FTileMatrix::FWallSpawnPoint>& WallSpawnPoints);
+
+	/**
+	 * Checks that the meshes needed for spawning are assigned and returns the tile size they use
+	 * @param OutTileSize - the size of each tile
+	 * @return false if the dungeon cannot be spawned
+	 */
+	bool GetSpawnTileSize(float& OutTileSize);
+
+	/**
+	 * Picks the seed of a new generation based on bUseRandomSeed and stores it in GenerationSeed
+	 */
+	void PickGenerationSeed();
+
+	/**
+	 * Called on the game thread once TileMatrix holds a freshly generated dungeon.
+	 * The server publishes the GenerationDescriptor while clients check their layout against it
+	 */
+	void OnTileMatrixGenerated();
+
+	/**
+	 * Copies the generation properties of a descriptor and generates the dungeon they describe
+	 */
+	void GenerateDungeonFromDescriptor(const FDungeonGenerationDescriptor& Descriptor);
+
+	/**
+	 * Regenerates the dungeon of the server on clients
+	 */
+	UFUNCTION()
+	void OnRep_GenerationDescriptor();
+
+	/**
+	 * Returns a hash of the properties that affect the layout (including the GenerationSeed). Used as the key of the layout cache
+	 */
+	uint32 GetLayoutCacheKey() const;
+
+	/**
+	 * Creates the rooms of a configured tile matrix or loads them from the layout cache. Safe to call from any thread
+	 * @param InTileMatrix - a tile matrix configured by ConfigureTileMatrix
+	 * @param RoomsNum - the rooms to generate
+	 * @param LayoutCacheKey - the key returned by GetLayoutCacheKey
+	 * @param bUseLayoutCache - false to always generate the layout
+	 * @param bUseLayoutFiles - true to also search & write layout files
+	 */
+	static void GenerateLayout(FTileMatrix& InTileMatrix, int32 RoomsNum, uint32 LayoutCacheKey, bool bUseLayoutCache, bool bUseLayoutFiles);
+
+	/**
+	 * Projects a generated tile matrix into world locations. Safe to call from any thread
+	 * @param InTileMatrix - the generated tile matrix
+	 * @param TileSize - the size of each tile
+	 * @param bSplitRooms - true to project each room separately (data table dungeons)
+	 * @param OutSpawnData - the projected locations
+	 */
+	static void ProjectTileMatrix(FTileMatrix& InTileMatrix, float TileSize, bool bSplitRooms, FDungeonSpawnData& OutSpawnData);
+
+	/**
+	 * Replaces any previously generated meshes with the projected locations.
+	 * Data table dungeons pick their templates first and load the assets of the picked templates before spawning;
+	 * asynchronously during gameplay and right away in the editor
+	 */
+	void SpawnDungeon(FDungeonSpawnData&& SpawnData);
+
+protected:
+
 	/**
 	 * Checks if a wall mesh needs to be rotated by 90 degrees
 	 * @param bWallFacingXProperty - true if the wall mesh we're using is facing the X axis
@@ -102,17 +586,32 @@ private:
 	FRotator CalculateWallRotation(bool bWallFacingXProperty, const FTileMatrix::FWallSpawnPoint& WallSpawnPoint, const FVector& WallPivotOffsetOverride, FVector& LocationOffset) const;
 
 	/**
-	 * Spawns a dungeon using random room templates from a provided data table
-	 * Assumes the data table contains correct values in terms of mesh sizes etc.
+	 * Returns the transform of a wall mesh. Merged wall segments stretch the mesh along its length to cover every tile edge of the segment
+	 * @param bWallFacingXProperty - true if the wall mesh we're using is facing the X axis
+	 * @param WallSpawnPoint - the wall spawn point we're using in order to spawn the wall
+	 * @param WallPivotOffsetOverride - the pivot offset of the wall mesh
 	 */
-	void SpawnDungeonFromDataTable();
+	FTransform CalculateWallTransform(bool bWallFacingXProperty, const FTileMatrix::FWallSpawnPoint& WallSpawnPoint, const FVector& WallPivotOffsetOverride) const;
 
 	/**
-	 * Spawns a generic dungeon using the same floor mesh and wall mesh for all the rooms/corridors
-	 * @param FloorTileLocation - the locations for each floor tile
-	 * @param WallSpawnPoints - the spawn points for each wall
+	 * Returns the transform of a floor mesh. Merged floor rectangles scale the mesh to cover every tile of the rectangle
+	 * @param FloorSpawnPoint - the floor spawn point we're using in order to spawn the floor
+	 * @param FloorPivotOffsetOverride - the pivot offset of the floor mesh
 	 */
-	void SpawnGenericDungeon(const TArray<FVector>& FloorTileLocations, const TArray<FTileMatrix::FWallSpawnPoint>& WallSpawnPoints);
+	FTransform CalculateFloorTransform(const FTileMatrix::FFloorSpawnPoint& FloorSpawnPoint, const FVector& FloorPivotOffsetOverride) const;
+
+	/**
+	 * Creates a procedural mesh component with the merged sections of a group
+	 * @param Merger - a built mesh merger
+	 * @param Group - the group of the merger to use
+	 * @return the new component or nullptr if the group is empty
+	 */
+	UProceduralMeshComponent* CreateMergedMeshComponent(const FDungeonMeshMerger& Merger, int32 Group);
+
+	/**
+	 * Copies the generation properties (and the GenerationSeed) into a tile matrix
+	 */
+	void ConfigureTileMatrix(FTileMatrix& InTileMatrix) const;
 
 public:
 	// Sets default values for this actor's properties
@@ -132,6 +631,12 @@ protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	virtual void Tick(float DeltaSeconds) override;
+
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
 	/**
 	 * Number of rows in tile map
 	 * Total size of tile map will be Rows * Columns
@@ -163,6 +668,43 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties")
 	int32 RoomsToGenerate = 15;
 
+	/**
+	 * If true, every generation uses a new random seed. Otherwise Seed is used so the same seed & properties always generate the same dungeon
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties")
+	bool bUseRandomSeed = true;
+
+	/**
+	 * The seed to generate the dungeon from when bUseRandomSeed is false
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties", meta = (EditCondition = "!bUseRandomSeed"))
+	int32 Seed = 0;
+
+	/**
+	 * The seed of the latest generated dungeon. Copy it to Seed to generate the same dungeon again
+	 */
+	UPROPERTY(VisibleInstanceOnly, BlueprintReadOnly, Category = "Generator Properties")
+	int32 GenerationSeed = 0;
+
+	/**
+	 * If true, layouts generated from a fixed Seed are cached in memory so generating the same seed & properties again skips room generation
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties")
+	bool bCacheLayouts = true;
+
+	/**
+	 * If true, cached layouts are also written to (and read from) Saved/DungeonLayouts so they survive restarts
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties", meta = (EditCondition = "bCacheLayouts"))
+	bool bCacheLayoutsOnDisk = true;
+
+	/**
+	 * Describes the latest dungeon generated by the server.
+	 * Replicated instead of the spawned meshes; clients generate the same dungeon locally from it
+	 */
+	UPROPERTY(ReplicatedUsing = OnRep_GenerationDescriptor, VisibleInstanceOnly, BlueprintReadOnly, Category = "Generator Properties")
+	FDungeonGenerationDescriptor GenerationDescriptor;
+
 	/**
 	 * Max Random Attempts for each room. To avoid an infinite loop try to find a fitting room for a location only a certain amount of times.
 	 * If the process fails just proceed to the next room
@@ -170,6 +712,85 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category= "Generator Properties")
 	int32 MaxRandomAttemptsPerRoom = 1500;
 
+	/**
+	 * If true, rooms are only placed in locations that are known to fit them so you get RoomsToGenerate rooms whenever there is space for them.
+	 * Disable to go back to MaxRandomAttemptsPerRoom random attempts for each room
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties")
+	bool bUseFreeSpaceIndex = true;
+
+	/**
+	 * Shape of the corridors that connect the rooms
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties")
+	EDungeonCorridorStyle CorridorStyle = EDungeonCorridorStyle::Greedy;
+
+	/**
+	 * Which rooms get connected with corridors
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties")
+	EDungeonRoomConnectivity RoomConnectivity = EDungeonRoomConnectivity::MinimumSpanningTree;
+
+	/**
+	 * Fraction of the candidate connections left out of the spanning tree that get a corridor anyway, creating loops.
+	 * 0 generates a dungeon with a single path between any two rooms
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties", meta = (ClampMin = 0.0, ClampMax = 1.0, EditCondition = "RoomConnectivity == EDungeonRoomConnectivity::MinimumSpanningTree"))
+	float ExtraConnectionsRatio = 0.1f;
+
+	/**
+	 * Number of nearest rooms each room considers as candidate connections.
+	 * Higher values give the spanning tree & the loops more connections to pick from at the cost of generation time
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties", meta = (ClampMin = 1, EditCondition = "RoomConnectivity == EDungeonRoomConnectivity::MinimumSpanningTree"))
+	int32 ConnectionCandidatesPerRoom = 6;
+
+	/**
+	 * Actors are easier to tweak one by one after generation while instanced meshes cost a fraction of the draw calls and spawn time
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties")
+	EDungeonSpawnMode SpawnMode = EDungeonSpawnMode::Actors;
+
+	/**
+	 * Max milliseconds per frame spent on spawning meshes during gameplay. Meshes closer to the player are spawned first.
+	 * Use 0 to spawn the whole dungeon in a single frame. Dungeons generated in the editor are always spawned right away
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties", meta = (ClampMin = 0.0))
+	float SpawnFrameBudgetMs = 0.f;
+
+	/**
+	 * Only used by EDungeonSpawnMode::Actors during gameplay. If true, the actors of a destroyed dungeon are hidden and reused by the next one
+	 * instead of being destroyed & spawned again, which avoids garbage collection spikes when regenerating
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties", meta = (EditCondition = "SpawnMode == EDungeonSpawnMode::Actors"))
+	bool bPoolMeshActors = true;
+
+	/**
+	 * Max hidden actors kept in the pool. Any other released actor is destroyed
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties", meta = (ClampMin = 0, EditCondition = "bPoolMeshActors && SpawnMode == EDungeonSpawnMode::Actors"))
+	int32 MaxPooledMeshActors = 20000;
+
+	/**
+	 * Once a dungeon has finished spawning, the pooled actors it didn't need are destroyed down to this many.
+	 * Keeps the pool from holding on to the actors of a much bigger previous dungeon
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties", meta = (ClampMin = 0, EditCondition = "bPoolMeshActors && SpawnMode == EDungeonSpawnMode::Actors"))
+	int32 PooledMeshActorsSlack = 1000;
+
+	/**
+	 * Only used by EDungeonSpawnMode::MergedMeshes. Meshes that don't belong to a room (ie corridors and generic dungeons) are merged
+	 * in square cells of this size so big dungeons still get culled in pieces
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties", meta = (ClampMin = 100.0, EditCondition = "SpawnMode == EDungeonSpawnMode::MergedMeshes"))
+	float MergedMeshCellSize = 4000.f;
+
+	/**
+	 * Only used by EDungeonSpawnMode::MergedMeshes. If true, collision is cooked (asynchronously) for the merged meshes
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties", meta = (EditCondition = "SpawnMode == EDungeonSpawnMode::MergedMeshes"))
+	bool bCreateMergedMeshCollision = true;
+
 	/**
 	 * The static mesh for each floor
 	 */
@@ -191,6 +812,19 @@ protected:
 	UPROPERTY(EditAnywhere, Category = "Generator Properties - Floor Settings")
 	FVector FloorPivotOffset;
 
+	/**
+	 * If true, the floor tiles of each room and of the corridors are covered by as few rectangles as possible, each spawned as a single scaled floor mesh.
+	 * Works best with floor meshes that can be stretched (or tile their material in world space)
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties - Floor Settings")
+	bool bMergeFloors = false;
+
+	/**
+	 * Max tiles along each side of a merged floor. Larger areas are split into multiple meshes. 0 means no limit
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties - Floor Settings", meta = (ClampMin = 0, EditCondition = "bMergeFloors"))
+	int32 MaxFloorRectSize = 0;
+
 	/**
 	 * Static mesh of walls
 	 */
@@ -212,6 +846,19 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties - Wall Settings")
 	bool bWallFacingX = true;
 
+	/**
+	 * If true, contiguous walls along the same side of a room or corridor are spawned as a single wall mesh, scaled along its length.
+	 * Cuts down the spawned walls on large rooms. Works best with wall meshes that can be stretched (or tile their material in world space)
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties - Wall Settings")
+	bool bMergeWalls = false;
+
+	/**
+	 * Max tiles covered by a single merged wall. Longer walls are split into multiple meshes. 0 means no limit
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Generator Properties - Wall Settings", meta = (ClampMin = 0, EditCondition = "bMergeWalls"))
+	int32 MaxWallSegmentLength = 0;
+
 	/**
 	 * A data table describing some room templates in order to spawn various floor tiles & wall meshes
 	 * Assumes that the assigned floor and wall meshes have the same dimensions as the generic floor and wall meshes
@@ -223,7 +870,7 @@ public:
 
 	/**
 	 * Will assign this tag to each mesh that is spawned by the generator.
-	 * Used to destroy any previously generated dungeons if needed
+	 * The generator keeps track of its own meshes so the tag is only there to tell them apart from other actors
 	 */
 	static const FName DUNGEON_MESH_TAG;
 
@@ -233,6 +880,85 @@ public:
 	UFUNCTION(BlueprintCallable, CallInEditor, Category = "Dungeon Generation")
 	void GenerateDungeon();
 
+	/**
+	 * Generates a dungeon on a background thread and spawns it on the game thread once it's ready.
+	 * Supersedes any generation that is still in flight. OnDungeonSpawned fires when the meshes are spawned
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Dungeon Generation")
+	void GenerateDungeonAsync();
+
+	/**
+	 * Abandons the background generation that is in flight, if any, along with the loading of its room template assets
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Dungeon Generation")
+	void CancelDungeonGeneration();
+
+	/**
+	 * Returns true while a background generation is in flight or the generated dungeon waits for its room template assets
+	 */
+	UFUNCTION(BlueprintPure, Category = "Dungeon Generation")
+	bool IsGeneratingDungeon() const;
+
+	/**
+	 * Returns the number of rooms in the generated dungeon
+	 */
+	UFUNCTION(BlueprintPure, Category = "Dungeon Layout")
+	int32 GetGeneratedRoomsNum() const;
+
+	/**
+	 * Returns the room that contains a world location or -1 if the location is in a corridor or outside of the dungeon
+	 */
+	UFUNCTION(BlueprintPure, Category = "Dungeon Layout")
+	int32 GetRoomAtLocation(const FVector& WorldLocation) const;
+
+	/**
+	 * Returns the world space bounds of a room (flat on the Z axis)
+	 * @return false if the room doesn't exist
+	 */
+	UFUNCTION(BlueprintPure, Category = "Dungeon Layout")
+	bool GetRoomBounds(int32 Room, FBox& OutBounds) const;
+
+	/**
+	 * Returns the centers of the room tiles that open towards a corridor or another room
+	 * @return false if the room doesn't exist
+	 */
+	UFUNCTION(BlueprintPure, Category = "Dungeon Layout")
+	bool GetRoomDoorLocations(int32 Room, TArray<FVector>& OutDoorLocations) const;
+
+	/**
+	 * Returns the rooms that are connected to a room by a corridor or that touch it
+	 * @return false if the room doesn't exist
+	 */
+	UFUNCTION(BlueprintPure, Category = "Dungeon Layout")
+	bool GetConnectedRooms(int32 Room, TArray<int32>& OutRooms) const;
+
+	/**
+	 * Destroys the meshes of a single room, including the ones still waiting to be spawned. Corridors and the other rooms are left untouched.
+	 * Not supported by EDungeonSpawnMode::InstancedMeshes since the instances of every room share the same components
+	 * @return false if nothing was spawned for the room
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Dungeon Generation")
+	bool DestroyDungeonRoom(int32 Room);
+
+	/**
+	 * Returns the counters of the mesh actor pool since the generator was created
+	 */
+	UFUNCTION(BlueprintPure, Category = "Dungeon Generation")
+	FDungeonMeshPoolStats GetMeshPoolStats() const;
+
+	/**
+	 * Destroys every pooled mesh actor. The meshes of the current dungeon are left untouched
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Dungeon Generation")
+	void EmptyMeshActorPool();
+
+	/**
+	 * Generates every following dungeon from the given seed (disables bUseRandomSeed)
+	 * @param NewSeed - the seed to use
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Dungeon Generation")
+	void SetSeed(int32 NewSeed);
+
 	/**
 	 * Sets new properties regarding the room size
 	 * @param NewMinRoomSize - the minimum room size (uniform)
@@ -266,6 +992,12 @@ public:
 	UPROPERTY(BlueprintAssignable, Category = "Dungeon Generation")
 	FOnDungeonSpawned OnDungeonSpawned;
 
+	/**
+	 * Called after each frame of a time-sliced spawn with the number of spawned meshes so far
+	 */
+	UPROPERTY(BlueprintAssignable, Category = "Dungeon Generation")
+	FOnDungeonSpawnProgress OnDungeonSpawnProgress;
+
 #if WITH_EDITORONLY_DATA
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Dungeon Generation - Debug")
@@ -0,0 +1,70 @@
+// Copyright (c) 2022 Orfeas Eleftheriou
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(DungeonLayoutCacheLog, Log, All);
+
+class FTileMatrix;
+
+/**
+ * Process-wide cache of generated tile layouts, keyed by a hash of the generation properties & seed.
+ * Layouts are kept in memory (so they survive level reloads) and optionally written to Saved/DungeonLayouts.
+ * Safe to use from any thread
+ */
+class DUNGEONGENERATORPLUGIN_API FDungeonLayoutCache
+{
+public:
+
+	static FDungeonLayoutCache& Get();
+
+	/**
+	 * Loads a cached layout into a tile matrix. Memory is searched first, then the disk
+	 * @param LayoutKey - hash of the generation properties & seed
+	 * @param OutTileMatrix - a tile matrix configured with the same properties. Receives the tile map & the rooms, and is left untouched if nothing loads.
+	 *                        Layout files that fail to load are deleted
+	 * @param bSearchDisk - true to look for a layout file if the layout isn't in memory
+	 * @return true if the layout was found and loaded
+	 */
+	bool Find(uint32 LayoutKey, FTileMatrix& OutTileMatrix, bool bSearchDisk);
+
+	/**
+	 * Caches the layout of a generated tile matrix
+	 * @param LayoutKey - hash of the generation properties & seed
+	 * @param InTileMatrix - the generated tile matrix
+	 * @param bWriteToDisk - true to also write a layout file
+	 */
+	void Add(uint32 LayoutKey, FTileMatrix& InTileMatrix, bool bWriteToDisk);
+
+	/**
+	 * Drops every layout kept in memory. Layout files are left untouched
+	 */
+	void Empty();
+
+	/**
+	 * Returns the file a layout is written to
+	 */
+	static FString GetLayoutFilePath(uint32 LayoutKey);
+
+	/**
+	 * Max layouts kept in memory. The oldest ones are dropped first
+	 */
+	int32 MaxMemoryLayouts = 32;
+
+private:
+
+	/* Serialized layouts, same format as the layout files */
+	TMap<uint32, TArray<uint8>> MemoryLayouts;
+
+	/* Keys of MemoryLayouts, oldest first */
+	TArray<uint32> MemoryLayoutKeys;
+
+	FCriticalSection CacheLock;
+
+	/**
+	 * Stores a serialized layout in memory, dropping the oldest layouts if needed. CacheLock must be held
+	 */
+	void AddToMemory(uint32 LayoutKey, TArray<uint8>&& LayoutData);
+};
@@ -0,0 +1,116 @@
+// Copyright (c) 2022 Orfeas Eleftheriou
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ProceduralMeshComponent.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(DungeonMeshMergerLog, Log, All);
+
+class UStaticMesh;
+class UMaterialInterface;
+
+/**
+ * Bakes copies of static meshes into a few mesh sections per group (ie per room or per chunk).
+ * Copies that end up with the same material are merged into the same section so each group needs one draw call per material.
+ * The source geometry is read from LOD 0 of the static meshes, so in packaged builds the meshes need "Allow CPU Access"
+ */
+class DUNGEONGENERATORPLUGIN_API FDungeonMeshMerger
+{
+public:
+
+	/**
+	 * Merged geometry of a group that uses a single material
+	 */
+	struct FMergedSection
+	{
+		UMaterialInterface* Material = nullptr;
+
+		/* Relative to the origin of the group */
+		TArray<FVector> Vertices;
+		TArray<int32> Triangles;
+		TArray<FVector> Normals;
+		TArray<FVector2D> UVs;
+		TArray<FProcMeshTangent> Tangents;
+	};
+
+	/**
+	 * Queues copies of a static mesh to be merged into a group.
+	 * Reads the render data of the mesh the first time it's used so it must be called on the game thread
+	 * @param Group - the group to merge the copies into. Groups are created on demand
+	 * @param Mesh - the mesh to copy
+	 * @param OverrideMaterial - if assigned, replaces the 1st material of the mesh
+	 * @param Transforms - the transforms of the copies
+	 * @return false if the geometry of the mesh couldn't be read
+	 */
+	bool AddMeshes(int32 Group, UStaticMesh* Mesh, UMaterialInterface* OverrideMaterial, TArrayView<const FTransform> Transforms);
+
+	/**
+	 * Builds the merged sections of every group. Groups are built in parallel
+	 */
+	void Build();
+
+	inline int32 GetGroupsNum() const { return Groups.Num(); }
+
+	/**
+	 * Returns the merged sections of a group. Only valid after Build
+	 */
+	inline const TArray<FMergedSection>& GetGroupSections(int32 Group) const { return Groups[Group].Sections; }
+
+	/**
+	 * Returns the world location the vertices of a group are relative to (the location of the first copy of the group)
+	 */
+	inline const FVector& GetGroupOrigin(int32 Group) const { return Groups[Group].Origin; }
+
+private:
+
+	/**
+	 * Geometry of a section of a static mesh
+	 */
+	struct FSourceSection
+	{
+		int32 MaterialIndex = 0;
+		TArray<FVector> Vertices;
+		TArray<int32> Triangles;
+		TArray<FVector> Normals;
+		TArray<FVector2D> UVs;
+		TArray<FProcMeshTangent> Tangents;
+	};
+
+	/**
+	 * Copies of a mesh with the same materials
+	 */
+	struct FMeshCopies
+	{
+		const TArray<FSourceSection>* SourceSections = nullptr;
+
+		/* The material of each source section, with the override applied */
+		TArray<UMaterialInterface*> SectionMaterials;
+
+		TArray<FTransform> Transforms;
+	};
+
+	struct FGroup
+	{
+		FVector Origin = FVector::ZeroVector;
+		TArray<FMeshCopies> Copies;
+		TArray<FMergedSection> Sections;
+	};
+
+	/**
+	 * Geometry of every static mesh that has been added so far. Sections are heap allocated so the pointers of FMeshCopies stay valid
+	 */
+	TMap<UStaticMesh*, TSharedPtr<TArray<FSourceSection>>> SourceMeshes;
+
+	TArray<FGroup> Groups;
+
+	/**
+	 * Returns the geometry of a static mesh, reading it on first use. Empty if the geometry isn't accessible
+	 */
+	const TArray<FSourceSection>& FindOrReadSourceMesh(UStaticMesh* Mesh);
+
+	/**
+	 * Merges the copies of a group into its sections
+	 */
+	static void BuildGroup(FGroup& Group);
+};
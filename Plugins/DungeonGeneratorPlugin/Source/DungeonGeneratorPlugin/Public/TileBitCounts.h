@@ -0,0 +1,98 @@
+// Copyright (c) 2022 Orfeas Eleftheriou
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class FTileBitGrid;
+
+/**
+ * Per-row prefix counts of the set bits of an FTileBitGrid: for every word of a row, the set bits of the row before that word.
+ * Counting the set bits of a row span takes two lookups and two popcounts, so a rectangle costs one row span per row regardless of its width.
+ *
+ * Changing bits only invalidates the counts of the same row from the changed word onwards, so the owner calls UpdateRow
+ * right after it changes a row and the counts never go stale. Takes 32 bits per 64 tiles on top of the grid.
+ * The counts of the rows are also kept in a Fenwick tree so the n-th set bit of the grid can be found without scanning it
+ */
+class DUNGEONGENERATORPLUGIN_API FTileBitCounts
+{
+public:
+
+	FTileBitCounts();
+
+	/**
+	 * Resizes the counts to the dimensions of a grid and counts all of its bits
+	 * @param Grid - the grid these counts mirror. Every query expects the same grid
+	 */
+	void Init(const FTileBitGrid& Grid);
+
+	/**
+	 * Recounts a row after some of its bits changed. Costs one popcount per word from FirstColumn to the end of the row
+	 * @param Grid - the grid these counts mirror
+	 * @param Row - the changed row
+	 * @param FirstColumn - the first column that changed
+	 */
+	void UpdateRow(const FTileBitGrid& Grid, int32 Row, int32 FirstColumn);
+
+	/**
+	 * Returns the number of set bits in [FirstColumn, LastColumn] of a row. The span must be inside the grid
+	 */
+	int32 CountRowSpan(const FTileBitGrid& Grid, int32 Row, int32 FirstColumn, int32 LastColumn) const;
+
+	/**
+	 * Returns the number of set bits of the (inclusive) rectangle. The rectangle must be inside the grid
+	 */
+	int32 CountRect(const FTileBitGrid& Grid, int32 MinRow, int32 MinColumn, int32 MaxRow, int32 MaxColumn) const;
+
+	/**
+	 * Returns true if no bit of the (inclusive) rectangle is set. The rectangle must be inside the grid
+	 */
+	bool IsRectEmpty(const FTileBitGrid& Grid, int32 MinRow, int32 MinColumn, int32 MaxRow, int32 MaxColumn) const;
+
+	/**
+	 * Returns the number of set bits of a row
+	 */
+	inline int32 GetRowCount(int32 Row) const { return WordPrefixes[Row * (WordsPerRow + 1) + WordsPerRow]; }
+
+	/**
+	 * Returns the number of set bits of the whole grid
+	 */
+	inline int32 GetTotalCount() const { return TotalCount; }
+
+	/**
+	 * Finds the n-th set bit of the grid in row-major order. Costs a binary search over the rows and one over the words of a row
+	 * @param Grid - the grid these counts mirror
+	 * @param Index - zero based index of the set bit. Must be less than GetTotalCount()
+	 * @param OutRow - the row of the set bit
+	 * @param OutColumn - the column of the set bit
+	 */
+	void FindNthSetBit(const FTileBitGrid& Grid, int32 Index, int32& OutRow, int32& OutColumn) const;
+
+	/**
+	 * Returns the heap memory used by the counts
+	 */
+	inline SIZE_T GetAllocatedSize() const { return WordPrefixes.GetAllocatedSize() + RowTree.GetAllocatedSize(); }
+
+private:
+
+	int32 RowsNum;
+	int32 WordsPerRow;
+
+	/**
+	 * WordsPerRow + 1 counts per row. Element w of a row holds the set bits of the row in words [0, w),
+	 * so the first element is always zero and the last one is the count of the whole row
+	 */
+	TArray<int32> WordPrefixes;
+
+	int32 TotalCount;
+
+	/**
+	 * Fenwick tree over the counts of the rows. Element i (1-based) holds the counts of the rows [i - LowestBit(i), i)
+	 */
+	TArray<int32> RowTree;
+
+	/**
+	 * Returns the set bits of a row in the columns [0, Column). Column may be equal to the columns of the grid
+	 */
+	int32 CountBefore(const FTileBitGrid& Grid, int32 Row, int32 Column) const;
+};
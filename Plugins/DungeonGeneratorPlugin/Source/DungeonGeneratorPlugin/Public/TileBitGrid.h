@@ -0,0 +1,171 @@
+// Copyright (c) 2022 Orfeas Eleftheriou
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Contiguous, row-major occupancy bitset (64 tiles per word).
+ * Every row starts on a fresh word so a row span never straddles two rows and
+ * span/rectangle queries boil down to a couple of mask operations per row
+ */
+class DUNGEONGENERATORPLUGIN_API FTileBitGrid
+{
+public:
+
+	/* Number of tiles packed in a single word */
+	static constexpr int32 BitsPerWord = 64;
+
+	FTileBitGrid();
+
+	FTileBitGrid(int32 Rows, int32 Columns);
+
+	/**
+	 * Resizes the grid to Rows * Columns and clears every bit
+	 * @param Rows - the total number of rows
+	 * @param Columns - the total number of columns
+	 */
+	void Init(int32 Rows, int32 Columns);
+
+	/**
+	 * Clears every bit without touching the dimensions or the allocation
+	 */
+	void Reset();
+
+	inline int32 GetRowsNum() const { return RowsNum; }
+
+	inline int32 GetColumnsNum() const { return ColumnsNum; }
+
+	inline int32 GetWordsPerRow() const { return WordsPerRow; }
+
+	/**
+	 * Checks if a location is inside the grid
+	 */
+	inline bool IsValidIndex(int32 Row, int32 Column) const
+	{
+		return Row >= 0 && Row < RowsNum && Column >= 0 && Column < ColumnsNum;
+	}
+
+	/**
+	 * Returns the bit of a location. The location must be inside the grid
+	 */
+	inline bool Get(int32 Row, int32 Column) const
+	{
+		checkSlow(IsValidIndex(Row, Column));
+		return (Words[WordIndex(Row, Column)] >> (Column & (BitsPerWord - 1))) & 1;
+	}
+
+	/**
+	 * Sets the bit of a location. The location must be inside the grid
+	 */
+	inline void Set(int32 Row, int32 Column)
+	{
+		checkSlow(IsValidIndex(Row, Column));
+		Words[WordIndex(Row, Column)] |= uint64(1) << (Column & (BitsPerWord - 1));
+	}
+
+	/**
+	 * Clears the bit of a location. The location must be inside the grid
+	 */
+	inline void Clear(int32 Row, int32 Column)
+	{
+		checkSlow(IsValidIndex(Row, Column));
+		Words[WordIndex(Row, Column)] &= ~(uint64(1) << (Column & (BitsPerWord - 1)));
+	}
+
+	/**
+	 * Word level access. Bits past the last column of a row are always zero
+	 * @param Row - the row of the word
+	 * @param Word - the word index inside the row (ie Column / BitsPerWord)
+	 */
+	inline uint64 GetWord(int32 Row, int32 Word) const
+	{
+		checkSlow(Row >= 0 && Row < RowsNum && Word >= 0 && Word < WordsPerRow);
+		return Words[Row * WordsPerRow + Word];
+	}
+
+	/**
+	 * Returns a pointer to the first word of a row. The row contains GetWordsPerRow() words
+	 */
+	inline const uint64* GetRowData(int32 Row) const
+	{
+		checkSlow(Row >= 0 && Row < RowsNum);
+		return Words.GetData() + Row * WordsPerRow;
+	}
+
+	/**
+	 * Checks if all the bits in [FirstColumn, LastColumn] of a row are cleared. The span must be inside the grid
+	 */
+	bool IsRowSpanEmpty(int32 Row, int32 FirstColumn, int32 LastColumn) const;
+
+	/**
+	 * Checks if all the bits in [FirstColumn, LastColumn] of a row are set. The span must be inside the grid
+	 */
+	bool IsRowSpanFull(int32 Row, int32 FirstColumn, int32 LastColumn) const;
+
+	/**
+	 * Sets all the bits in [FirstColumn, LastColumn] of a row. The span must be inside the grid
+	 */
+	void SetRowSpan(int32 Row, int32 FirstColumn, int32 LastColumn);
+
+	/**
+	 * Clears all the bits in [FirstColumn, LastColumn] of a row. The span must be inside the grid
+	 */
+	void ClearRowSpan(int32 Row, int32 FirstColumn, int32 LastColumn);
+
+	/**
+	 * Checks if every bit of the (inclusive) rectangle is cleared. The rectangle must be inside the grid
+	 */
+	bool IsRectEmpty(int32 MinRow, int32 MinColumn, int32 MaxRow, int32 MaxColumn) const;
+
+	/**
+	 * Sets every bit of the (inclusive) rectangle. The rectangle must be inside the grid
+	 */
+	void SetRect(int32 MinRow, int32 MinColumn, int32 MaxRow, int32 MaxColumn);
+
+	/**
+	 * Finds every Size * Size square of cleared bits. Works on whole words so it costs about Rows * Columns * Size / BitsPerWord word operations
+	 * @param Size - the side of the squares
+	 * @param OutCorners - resized to match this grid. Gets a bit set on the upper-left corner of every square
+	 */
+	void FindEmptySquares(int32 Size, FTileBitGrid& OutCorners) const;
+
+	/**
+	 * Returns the number of set bits in the whole grid
+	 */
+	int32 CountSetBits() const;
+
+	/**
+	 * Returns the heap memory used by the grid
+	 */
+	inline SIZE_T GetAllocatedSize() const { return Words.GetAllocatedSize(); }
+
+	/**
+	 * Saves or loads the dimensions and the packed bits of the grid.
+	 * Raises an error on the archive if the loaded data doesn't describe a valid grid
+	 */
+	void Serialize(FArchive& Ar);
+
+private:
+
+	int32 RowsNum;
+	int32 ColumnsNum;
+	int32 WordsPerRow;
+
+	/* Row-major words. Row i occupies [i * WordsPerRow, (i + 1) * WordsPerRow) */
+	TArray<uint64> Words;
+
+	inline int32 WordIndex(int32 Row, int32 Column) const
+	{
+		return Row * WordsPerRow + Column / BitsPerWord;
+	}
+
+	/**
+	 * Builds a mask with the bits [FirstBit, LastBit] set. Both bits must be in [0, BitsPerWord)
+	 */
+	static inline uint64 SpanMask(int32 FirstBit, int32 LastBit)
+	{
+		const uint64 UpperMask = (LastBit == BitsPerWord - 1) ? ~uint64(0) : ((uint64(1) << (LastBit + 1)) - 1);
+		return UpperMask & (~uint64(0) << FirstBit);
+	}
+};
@@ -3,6 +3,10 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "TileBitGrid.h"
+#include "TileBitCounts.h"
+#include "CorridorRouter.h"
+#include <atomic>
 
 DECLARE_LOG_CATEGORY_EXTERN(TileMatrixLog, Log, All);
 
@@ -31,11 +35,38 @@ public:
 
 		bool bFacingX;
 
-		FWallSpawnPoint() : WorldLocation(FVector()), bFacingX(true) {}
+		/* Number of tile edges covered by this wall. Greater than 1 for merged wall segments, in which case WorldLocation is the center of the segment */
+		int32 Length;
 
-		FWallSpawnPoint(FVector NewWorldLocation) : WorldLocation(NewWorldLocation), bFacingX(true) {}
+		FWallSpawnPoint() : WorldLocation(FVector()), bFacingX(true), Length(1) {}
 
-		FWallSpawnPoint(FVector NewWorldLocation, bool IsFacingX) : WorldLocation(NewWorldLocation), bFacingX(IsFacingX) {}
+		FWallSpawnPoint(FVector NewWorldLocation) : WorldLocation(NewWorldLocation), bFacingX(true), Length(1) {}
+
+		FWallSpawnPoint(FVector NewWorldLocation, bool IsFacingX) : WorldLocation(NewWorldLocation), bFacingX(IsFacingX), Length(1) {}
+
+		FWallSpawnPoint(FVector NewWorldLocation, bool IsFacingX, int32 NewLength) : WorldLocation(NewWorldLocation), bFacingX(IsFacingX), Length(NewLength) {}
+	};
+
+	/**
+	 * Stores a floor spawn point in the world.
+	 * Covers a single tile, or a rectangle of tiles when the floors are merged
+	 */
+	struct FFloorSpawnPoint
+	{
+		/* World location of the center of the covered tiles */
+		FVector WorldLocation;
+
+		/* Covered tiles along the rows (X axis) */
+		int32 Rows;
+
+		/* Covered tiles along the columns (Y axis) */
+		int32 Columns;
+
+		FFloorSpawnPoint() : WorldLocation(FVector()), Rows(1), Columns(1) {}
+
+		FFloorSpawnPoint(FVector NewWorldLocation) : WorldLocation(NewWorldLocation), Rows(1), Columns(1) {}
+
+		FFloorSpawnPoint(FVector NewWorldLocation, int32 NewRows, int32 NewColumns) : WorldLocation(NewWorldLocation), Rows(NewRows), Columns(NewColumns) {}
 	};
 
 	FTileMatrix();
@@ -62,6 +93,12 @@ public:
 	 */
 	void SetRoomSize(int32 NewMinRoomSize, int32 NewMaxRoomSize);
 
+	/**
+	 * Drives every random decision of the generation (room sizes & locations).
+	 * Seeded with a new seed on construction. Initialize it with a known seed before CreateRooms to get the same layout for the same seed & settings
+	 */
+	FRandomStream RandomStream;
+
 	/**
 	 * Max Random Attempts for each room. To avoid an infinite loop try to find a fitting room for a location only a certain amount of times.
 	 * If the process fails just proceed to the next room
@@ -69,32 +106,364 @@ public:
 	int32 MaxRandomAttemptsPerRoom = 1500;
 
 	/**
-	 * Will try to create <=RoomCount rooms in the tilemap.
-	 * If you're unlucky with the pseudorandoms you'll get fewer rooms.
+	 * If true, rooms are sampled from an index of locations that are known to fit them instead of random tiles.
+	 * A room is only skipped when there is no free space left for a room of MinRoomSize. On crowded maps rooms may end up smaller than their random size.
+	 * If false, falls back to the MaxRandomAttemptsPerRoom random attempts per room
+	 */
+	bool bUseFreeSpaceIndex = true;
+
+	/**
+	 * How rooms get connected to each other
+	 */
+	enum class ERoomConnectivity : uint8
+	{
+		/* Each new room connects to the previously generated room while rooms are being placed */
+		Chain,
+		/* Once all rooms are placed, connects the rooms along a minimum spanning tree of their centers plus a few extra connections */
+		MinimumSpanningTree
+	};
+
+	ERoomConnectivity RoomConnectivity = ERoomConnectivity::MinimumSpanningTree;
+
+	/**
+	 * Only used by ERoomConnectivity::MinimumSpanningTree.
+	 * Fraction of the remaining candidate connections (shortest first) that are routed on top of the tree to create loops.
+	 * 0 generates a tree, 1 routes every candidate connection
+	 */
+	float ExtraConnectionsRatio = 0.1f;
+
+	/**
+	 * Only used by ERoomConnectivity::MinimumSpanningTree.
+	 * Number of nearest rooms each room considers as candidate connections
+	 */
+	int32 ConnectionCandidatesPerRoom = 6;
+
+	/**
+	 * If assigned, room placement and room connection stop early once the flag is raised.
+	 * Used to abandon generations that run in the background
+	 */
+	const std::atomic<bool>* CancellationFlag = nullptr;
+
+	/**
+	 * Returns true if the CancellationFlag has been raised
+	 */
+	inline bool IsCancelled() const { return CancellationFlag && CancellationFlag->load(std::memory_order_relaxed); }
+
+	/**
+	 * Will try to create <=RoomCount rooms in the tilemap and connect them.
+	 * Same as PlaceRooms followed by ConnectGeneratedRooms.
+	 * When bUseFreeSpaceIndex is false and you're unlucky with the pseudorandoms you'll get fewer rooms.
 	 * If you're getting a lower room count than what you expect try to fine tune Rows and Columns of TileMap as well as the MaxRandomAttemptsPerRoom
 	 * @param RoomCount - max rooms to generate
 	 */
 	void CreateRooms(int32 RoomCount);
 
+	/**
+	 * Will try to place <=RoomCount rooms in the tilemap (and no more than MaxRoomsNum in total).
+	 * With ERoomConnectivity::Chain the rooms are also connected as they're placed
+	 * @param RoomCount - max rooms to generate
+	 */
+	void PlaceRooms(int32 RoomCount);
+
+	/**
+	 * Connects the placed rooms along a minimum spanning tree of their centers (plus ExtraConnectionsRatio loops).
+	 * Candidate connections come from a grid-bucketed k-nearest-neighbor graph so the whole stage is O(n log n).
+	 * Doesn't route anything with ERoomConnectivity::Chain since the rooms are connected during PlaceRooms.
+	 * Either way, assigns the corridor indices and updates the room structure (door tiles, neighbors) afterwards
+	 */
+	void ConnectGeneratedRooms();
+
+	/**
+	 * Marks a tile on the edge of the tile map as an opening towards a neighbor tile map (see ConnectBorderPortals).
+	 * Border portals don't get walls on the side that faces out of the map
+	 * @param Row - the row of a tile on the edge of the tile map
+	 * @param Column - the column of a tile on the edge of the tile map
+	 */
+	void AddBorderPortal(int32 Row, int32 Column);
+
+	/**
+	 * Occupies every border portal and connects it to its closest room with a corridor.
+	 * Without any rooms, the portals are connected to each other instead.
+	 * Updates the corridor indices and the room structure afterwards
+	 */
+	void ConnectBorderPortals();
+
+	/**
+	 * Shapes of the corridors that connect rooms
+	 */
+	enum class ECorridorStyle : uint8
+	{
+		/* Same tiles as the original greedy walk: moves up first, then sideways and finally down */
+		Greedy,
+		/* Single bend. Covers the longer axis first */
+		LShaped,
+		/* Two bends. Covers half of the longer axis, the whole shorter axis and then the rest of the longer axis */
+		ZShaped,
+		/* Cheapest path through the tile costs (see FCorridorRoutingCosts). Prefers existing corridors and goes around rooms */
+		Routed
+	};
+
+	/**
+	 * Shape of the generated corridors
+	 */
+	ECorridorStyle CorridorStyle = ECorridorStyle::Greedy;
+
+	/**
+	 * Costs of entering a tile when routing corridors (ECorridorStyle::Routed). A cost of 0 blocks the tile
+	 */
+	struct FCorridorRoutingCosts
+	{
+		/* Cost of digging through an empty tile */
+		uint8 EmptyTileCost = 3;
+
+		/* Cost of walking along an existing corridor. Lower than EmptyTileCost so corridors merge instead of running in parallel */
+		uint8 CorridorTileCost = 1;
+
+		/* Cost of crossing a room. Higher than EmptyTileCost so corridors go around rooms */
+		uint8 RoomTileCost = 30;
+
+		/**
+		 * Cost per tile used to estimate the remaining distance to the target room.
+		 * Corridors are the cheapest possible when it's <= CorridorTileCost but the router expands a lot more tiles.
+		 * When it matches EmptyTileCost the router expands roughly as many tiles as the corridor length
+		 * at the expense of merging fewer corridors
+		 */
+		int32 HeuristicCost = 3;
+	};
+
+	/**
+	 * Applied to the tile costs when the tile map is initialized and when tiles get occupied,
+	 * so assign them before InitTileMap
+	 */
+	FCorridorRoutingCosts RoutingCosts;
+
+	/**
+	 * Overrides the routing cost of a single tile. Use a cost of 0 to keep corridors out of a tile.
+	 * Rooms & corridors that are generated afterwards replace the cost of their tiles
+	 * @param Row - the row of the tile
+	 * @param Column - the column of the tile
+	 * @param Cost - the new cost of entering the tile
+	 */
+	void SetTileCost(int32 Row, int32 Column, uint8 Cost);
+
+	/**
+	 * Statistics of the last CreateRooms call
+	 */
+	struct FRoomPlacementStats
+	{
+		/* Rooms requested in CreateRooms */
+		int32 RoomsRequested = 0;
+
+		/* Rooms that made it into the tile map */
+		int32 RoomsPlaced = 0;
+
+		/* Locations tested for a room (random tiles or sampled candidates) */
+		int32 PlacementAttempts = 0;
+
+		/* Candidates that were found occupied when sampled and got removed from the free space index */
+		int32 StaleCandidates = 0;
+
+		/**
+		 * Estimated random attempts that were avoided by sampling from the free space index.
+		 * Based on the odds of a random tile fitting the room (capped at MaxRandomAttemptsPerRoom per room)
+		 */
+		int64 EstimatedAttemptsSaved = 0;
+	};
+
+	/**
+	 * Returns the statistics of the last CreateRooms call
+	 */
+	inline const FRoomPlacementStats& GetPlacementStats() const { return PlacementStats; }
+
+	/**
+	 * Max rooms of a tile matrix. Room labels are 15 bits wide
+	 */
+	static constexpr int32 MaxRoomsNum = 0x7FFF;
+
+	/**
+	 * Label of the empty tiles
+	 */
+	static constexpr uint16 EmptyTileLabel = 0;
+
+	/**
+	 * Set on the labels of corridor tiles. The rest of the bits hold the corridor index
+	 */
+	static constexpr uint16 CorridorLabelFlag = 0x8000;
+
+	/**
+	 * Returns the label of a tile: EmptyTileLabel, RoomIndex + 1 for room tiles or CorridorLabelFlag | CorridorIndex for corridor tiles.
+	 * Room labels are written as rooms are placed. Corridor indices are assigned once the rooms are connected (see ConnectGeneratedRooms)
+	 */
+	inline uint16 GetTileLabel(int32 Row, int32 Column) const { return TileMap.IsValidIndex(Row, Column) ? TileLabels[Row * ColumnsNum + Column] : EmptyTileLabel; }
+
+	/**
+	 * Returns the room a tile belongs to or INDEX_NONE for corridor & empty tiles
+	 */
+	inline int32 GetTileRoom(int32 Row, int32 Column) const { return GetLabelRoom(GetTileLabel(Row, Column)); }
+
+	/**
+	 * Returns the corridor a tile belongs to or INDEX_NONE for room & empty tiles
+	 */
+	inline int32 GetTileCorridor(int32 Row, int32 Column) const { return GetLabelCorridor(GetTileLabel(Row, Column)); }
+
+	static inline int32 GetLabelRoom(uint16 Label) { return (Label != EmptyTileLabel && !(Label & CorridorLabelFlag)) ? Label - 1 : INDEX_NONE; }
+
+	static inline int32 GetLabelCorridor(uint16 Label) { return (Label & CorridorLabelFlag) ? (Label & ~CorridorLabelFlag) : INDEX_NONE; }
+
+	inline int32 GetRowsNum() const { return RowsNum; }
+
+	inline int32 GetColumnsNum() const { return ColumnsNum; }
+
+	/**
+	 * Structure of a generated room. Door tiles & neighbors are slices of shared arrays (see GetRoomDoorTiles & GetRoomNeighbors)
+	 */
+	struct FRoomLayoutInfo
+	{
+		/* Inclusive bounds of the room tiles */
+		int32 MinRow = 0;
+		int32 MinColumn = 0;
+		int32 MaxRow = -1;
+		int32 MaxColumn = -1;
+
+		int32 TilesNum = 0;
+
+		int32 FirstDoorTile = 0;
+		int32 DoorTilesNum = 0;
+
+		int32 FirstNeighbor = 0;
+		int32 NeighborsNum = 0;
+	};
+
+	/**
+	 * Connected group of corridor tiles. The rooms it touches are a slice of a shared array (see GetCorridorRooms)
+	 */
+	struct FCorridorLayoutInfo
+	{
+		int32 TilesNum = 0;
+
+		int32 FirstRoom = 0;
+		int32 RoomsNum = 0;
+	};
+
+	inline int32 GetRoomsNum() const { return RoomInfos.Num(); }
+
+	inline const FRoomLayoutInfo& GetRoomInfo(int32 Room) const { return RoomInfos[Room]; }
+
+	/**
+	 * Returns the tiles (Row * Columns + Column) of a room that touch a corridor or another room
+	 */
+	inline TArrayView<const int32> GetRoomDoorTiles(int32 Room) const { return TArrayView<const int32>(RoomDoorTiles.GetData() + RoomInfos[Room].FirstDoorTile, RoomInfos[Room].DoorTilesNum); }
+
+	/**
+	 * Returns the rooms that got connected to a room by a corridor or that touch it, sorted by index
+	 */
+	inline TArrayView<const int32> GetRoomNeighbors(int32 Room) const { return TArrayView<const int32>(RoomNeighbors.GetData() + RoomInfos[Room].FirstNeighbor, RoomInfos[Room].NeighborsNum); }
+
+	inline int32 GetCorridorsNum() const { return CorridorInfos.Num(); }
+
+	inline const FCorridorLayoutInfo& GetCorridorInfo(int32 Corridor) const { return CorridorInfos[Corridor]; }
+
+	/**
+	 * Returns the rooms that a corridor touches, sorted by index
+	 */
+	inline TArrayView<const int32> GetCorridorRooms(int32 Corridor) const { return TArrayView<const int32>(CorridorRooms.GetData() + CorridorInfos[Corridor].FirstRoom, CorridorInfos[Corridor].RoomsNum); }
+
 	/**
 	 * Prints the generated Tile Map in the console
 	 */
 	void PrintDebugTileMap() const;
 
+	/**
+	 * Returns a checksum of the occupied tiles. Two tile matrices with the same layout have the same hash
+	 */
+	uint32 GetLayoutHash() const;
+
+	/**
+	 * Versions of the layout format written by Serialize
+	 */
+	enum class ELayoutVersion : int32
+	{
+		Initial = 1,
+		BorderPortals = 2,
+		RoomConnections = 3,
+		RoomRecords = 4,
+
+		LatestVersion = RoomRecords
+	};
+
+	/**
+	 * Saves or loads the generated layout: the bit-packed tile map, the generated rooms, the border portals and the room connections.
+	 * Rooms are stored as their bounds. Corridor tiles are the occupied tiles outside of the rooms so they aren't stored separately.
+	 * Loading replaces the tile map & rooms but keeps the generation settings. Layouts of other versions fail to load (the archive is marked with an error).
+	 * A failed load leaves the tile matrix partially loaded, so load into a copy when the original has to survive (see FDungeonLayoutCache)
+	 */
+	void Serialize(FArchive& Ar);
+
+	/**
+	 * Returns the heap memory used by the tile matrix
+	 */
+	SIZE_T GetAllocatedSize() const;
+
+	/**
+	 * If true, the projection merges contiguous collinear wall edges that face the same side into a single FWallSpawnPoint with a Length.
+	 * Walls of different rooms (and of rooms & corridors) are never merged together
+	 */
+	bool bMergeWalls = false;
+
+	/**
+	 * Max tile edges of a merged wall segment. Longer runs are split. 0 means no limit
+	 */
+	int32 MaxWallSegmentLength = 0;
+
+	/**
+	 * If true, the projection covers the floor tiles with a near-minimal set of rectangles (greedy meshing) instead of one FFloorSpawnPoint per tile.
+	 * Floors of different rooms (and of rooms & corridors) are never merged together
+	 */
+	bool bMergeFloors = false;
+
+	/**
+	 * Max tiles along each side of a merged floor rectangle. Larger areas are split. 0 means no limit
+	 */
+	int32 MaxFloorRectSize = 0;
+
 	/**
 	 * Project the generated Tile Map in the world
 	 * @param TileSize - the size of each tile (ie floor size)
-	 * @param FloorLocations - the world location for every floor tile
+	 * @param FloorLocations - the floor spawn points. One per tile, or one per rectangle of tiles when bMergeFloors is true
 	 * @param WallLocations - the world locations for every wall mesh packed in a FWallSpawnPoint structure to handle any rotations that need to take place
 	 */
+	void ProjectTileMapLocationsToWorld(float TileSize, TArray<FFloorSpawnPoint>& FloorLocations, TArray<FWallSpawnPoint>& WallLocations);
+
+	/**
+	 * Projects a floor location per tile, ignoring bMergeFloors
+	 */
+	UE_DEPRECATED(5.4, "Floors are projected as FFloorSpawnPoint so they can cover rectangles of tiles. Use the FFloorSpawnPoint overload instead")
 	void ProjectTileMapLocationsToWorld(float TileSize, TArray<FVector>& FloorLocations, TArray<FWallSpawnPoint>& WallLocations);
 
 	struct FRoom
 	{
-		TArray<FVector> FloorTileWorldLocations;
+		TArray<FFloorSpawnPoint> FloorSpawnPoints;
 		TArray<FWallSpawnPoint> WallSpawnPoints;
+
+		UE_DEPRECATED(5.4, "Use FloorSpawnPoints instead. Only filled by the deprecated TArray<FVector> overload of ProjectTileMapLocationsToWorld")
+		TArray<FVector> FloorTileWorldLocations;
+
+		PRAGMA_DISABLE_DEPRECATION_WARNINGS
+		FRoom() = default;
+		FRoom(const FRoom&) = default;
+		FRoom(FRoom&&) = default;
+		FRoom& operator=(const FRoom&) = default;
+		FRoom& operator=(FRoom&&) = default;
+		~FRoom() = default;
+		PRAGMA_ENABLE_DEPRECATION_WARNINGS
 	};
 
+	void ProjectTileMapLocationsToWorld(float TileSize, TArray<FRoom>& Rooms, TArray<FFloorSpawnPoint>& CorridorFloorTiles, TArray<FWallSpawnPoint>& CorridorWalls);
+
+	/**
+	 * Projects a floor location per tile into FRoom::FloorTileWorldLocations & CorridorFloorTiles, ignoring bMergeFloors
+	 */
+	UE_DEPRECATED(5.4, "Floors are projected as FFloorSpawnPoint so they can cover rectangles of tiles. Use the FFloorSpawnPoint overload instead")
 	void ProjectTileMapLocationsToWorld(float TileSize, TArray<FRoom>& Rooms, TArray<FVector>& CorridorFloorTiles, TArray<FWallSpawnPoint>& CorridorWalls);
 
 protected:
@@ -126,11 +495,49 @@ private:
 	int32 ColumnsNum;
 
 	/**
-	 * Contents of this matrix.
-	 * True values mean that a location / tile is occupied.
-	 * False for tiles that are available
+	 * Contents of this matrix packed in a row-major bitset.
+	 * Set bits mean that a location / tile is occupied.
+	 * Cleared bits for tiles that are available
+	 */
+	FTileBitGrid TileMap;
+
+	/**
+	 * Per-row counts of the TileMap. Answers room fit queries with a single lookup per row.
+	 * Every function that occupies tiles recounts the changed rows right away
 	 */
-	TArray<TArray<bool>> TileMap;
+	FTileBitCounts OccupancyCounts;
+
+	/**
+	 * Routing cost of entering each tile (row-major). See FCorridorRoutingCosts
+	 */
+	TArray<uint8> TileCosts;
+
+	/**
+	 * Label of each tile (row-major). See GetTileLabel
+	 */
+	TArray<uint16> TileLabels;
+
+	/**
+	 * Room pairs that got connected by ConnectRooms, packed as (RoomA << 32) | RoomB
+	 */
+	TArray<int64> RoomConnections;
+
+	/* See GetRoomInfo, GetRoomDoorTiles & GetRoomNeighbors */
+	TArray<FRoomLayoutInfo> RoomInfos;
+	TArray<int32> RoomDoorTiles;
+	TArray<int32> RoomNeighbors;
+
+	/* See GetCorridorInfo & GetCorridorRooms */
+	TArray<FCorridorLayoutInfo> CorridorInfos;
+	TArray<int32> CorridorRooms;
+
+	/**
+	 * Path finder of the routed corridors. Keeps its scratch buffers between connections
+	 */
+	FCorridorRouter CorridorRouter;
+
+	/* Scratch buffer with the tile indices of the last routed corridor */
+	TArray<int32> RoutedPath;
 
 
 	/**
@@ -140,17 +547,84 @@ private:
 	int32 MaxRoomSize = 4;
 
 	/**
-	 * Gets a random tile from the TileMap
-	 * @return a random tile
+	 * Inclusive bounds of a rectangular room. Rooms are passed around as rects and their tiles are visited on demand
 	 */
-	Tile GetRandomTile() const;
+	struct FRoomRect
+	{
+		int32 MinRow = 0;
+		int32 MinColumn = 0;
+		int32 MaxRow = -1;
+		int32 MaxColumn = -1;
+
+		FRoomRect() {}
+
+		FRoomRect(int32 InMinRow, int32 InMinColumn, int32 InMaxRow, int32 InMaxColumn) : MinRow(InMinRow), MinColumn(InMinColumn), MaxRow(InMaxRow), MaxColumn(InMaxColumn) {}
+
+		/* Single tile room (ie a border portal) */
+		explicit FRoomRect(const Tile& InTile) : MinRow(InTile.Key), MinColumn(InTile.Value), MaxRow(InTile.Key), MaxColumn(InTile.Value) {}
+
+		inline int32 GetRowsNum() const { return MaxRow - MinRow + 1; }
+
+		inline int32 GetColumnsNum() const { return MaxColumn - MinColumn + 1; }
+
+		inline int32 GetTilesNum() const { return IsEmpty() ? 0 : GetRowsNum() * GetColumnsNum(); }
+
+		inline bool IsEmpty() const { return MaxRow < MinRow || MaxColumn < MinColumn; }
+	};
+
+	/**
+	 * Rooms in a structure-of-arrays layout: the first tile & the size of each room (12 bytes per room).
+	 * Sizes are 16 bits wide since a single tile map can't have 65536 * 65536 tiles anyway
+	 */
+	struct FRoomRecords
+	{
+		TArray<int32> MinRows;
+		TArray<int32> MinColumns;
+		TArray<uint16> RowsNums;
+		TArray<uint16> ColumnsNums;
+
+		inline int32 Num() const { return MinRows.Num(); }
+
+		inline FRoomRect Get(int32 Index) const
+		{
+			return FRoomRect(MinRows[Index], MinColumns[Index], MinRows[Index] + RowsNums[Index] - 1, MinColumns[Index] + ColumnsNums[Index] - 1);
+		}
+
+		inline void Add(const FRoomRect& Room)
+		{
+			MinRows.Add(Room.MinRow);
+			MinColumns.Add(Room.MinColumn);
+			RowsNums.Add(static_cast<uint16>(Room.GetRowsNum()));
+			ColumnsNums.Add(static_cast<uint16>(Room.GetColumnsNum()));
+		}
+
+		void Reserve(int32 Number)
+		{
+			MinRows.Reserve(Number);
+			MinColumns.Reserve(Number);
+			RowsNums.Reserve(Number);
+			ColumnsNums.Reserve(Number);
+		}
+
+		void Empty()
+		{
+			MinRows.Empty();
+			MinColumns.Empty();
+			RowsNums.Empty();
+			ColumnsNums.Empty();
+		}
+
+		inline SIZE_T GetAllocatedSize() const
+		{
+			return MinRows.GetAllocatedSize() + MinColumns.GetAllocatedSize() + RowsNums.GetAllocatedSize() + ColumnsNums.GetAllocatedSize();
+		}
+	};
 
 	/**
-	 * Gets nearby tiles of a tile
-	 * @param InTile - a tile in the tile map
-	 * @return an array of tiles, containing tiles with a distance of 1 in directions up, right, left and down
+	 * Gets a random tile from the TileMap
+	 * @return a random tile
 	 */
-	TArray<Tile> GetNearbyTiles(const Tile& InTile) const;
+	Tile GetRandomTile() const;
 
 	/**
 	 * Checking indices of tile to verify they are inside tile map's indices
@@ -165,12 +639,10 @@ private:
 	bool IsTileOccupied(Tile InTile) const;
 
 	/**
-	 * Checks if all provided tiles are:
-	 * Inside the tile map and
-	 * NOT occupied
-	 * @return true if all tiles are inside the tile map and available
+	 * Checks if a rectangle of tiles is inside the tile map and NOT occupied.
+	 * @return true if every tile of the (inclusive) rectangle is inside the tile map and available
 	 */
-	bool AreTilesValid(const TArray<Tile>& InTiles) const;
+	bool IsAreaAvailable(int32 MinRow, int32 MinColumn, int32 MaxRow, int32 MaxColumn) const;
 
 	/**
 	 * Gets the tile which is located on the left side of a given tile
@@ -204,30 +676,122 @@ private:
 	 */
 	bool GetDownTile(const Tile& InTile, Tile& DownTile) const;
 
-	TArray<FWallSpawnPoint> GenerateWallSpawnPointsFromNearbyTiles(const Tile& CenterTile, float TileSize) const;
+	/**
+	 * Appends a wall for every side of an occupied tile that needs one
+	 */
+	void AppendWallSpawnPoints(const Tile& CenterTile, float TileSize, TArray<FWallSpawnPoint>& OutWalls) const;
+
+	/**
+	 * Sides of a tile that need a wall
+	 */
+	enum EWallSide : uint8
+	{
+		WallSideUp = 1 << 0,
+		WallSideRight = 1 << 1,
+		WallSideDown = 1 << 2,
+		WallSideLeft = 1 << 3
+	};
+
+	/**
+	 * Returns the EWallSide flags of an occupied tile.
+	 * A side needs a wall when the nearby tile is empty or out of the tile map (unless the tile is a border portal)
+	 */
+	uint8 GetWallSides(const Tile& InTile) const;
+
+	/**
+	 * Rows (or columns) of a tile group that are projected by a single task
+	 */
+	static constexpr int32 ProjectionBlockSize = 64;
+
+	/**
+	 * Appends the up & down walls of a range of mask rows, merging contiguous edges that face the same side into segments
+	 * @param Mask - the tiles whose walls are merged together
+	 * @param FirstRow - the tile map row of the first mask row
+	 * @param FirstColumn - the tile map column of the first mask column
+	 * @param FirstMaskRow - the first mask row to scan
+	 * @param LastMaskRow - the last mask row to scan
+	 * @param TileSize - the size of each tile
+	 * @param OutWalls - the array to append the merged walls to
+	 */
+	void AppendMergedRowWalls(const FTileBitGrid& Mask, int32 FirstRow, int32 FirstColumn, int32 FirstMaskRow, int32 LastMaskRow, float TileSize, TArray<FWallSpawnPoint>& OutWalls) const;
+
+	/**
+	 * Appends the left & right walls of a range of mask columns, merging contiguous edges that face the same side into segments
+	 * @param FirstMaskColumn - the first mask column to scan
+	 * @param LastMaskColumn - the last mask column to scan
+	 */
+	void AppendMergedColumnWalls(const FTileBitGrid& Mask, int32 FirstRow, int32 FirstColumn, int32 FirstMaskColumn, int32 LastMaskColumn, float TileSize, TArray<FWallSpawnPoint>& OutWalls) const;
+
+	/**
+	 * Covers the set tiles of a range of mask rows with rectangles. Each rectangle takes the widest span of its first row and grows down while the rows below are full.
+	 * Rectangles don't grow past LastMaskRow and the covered tiles are cleared, so disjoint row ranges of the same mask can be merged in parallel
+	 * @param Mask - the tiles to cover
+	 * @param FirstMaskRow - the first mask row to cover
+	 * @param LastMaskRow - the last mask row to cover
+	 * @param FirstRow - the tile map row of the first mask row
+	 * @param FirstColumn - the tile map column of the first mask column
+	 * @param TileSize - the size of each tile
+	 * @param OutFloors - the array to append the rectangles to
+	 */
+	void AppendMergedFloors(FTileBitGrid& Mask, int32 FirstMaskRow, int32 LastMaskRow, int32 FirstRow, int32 FirstColumn, float TileSize, TArray<FFloorSpawnPoint>& OutFloors) const;
 
 	/**
-	 * Marks the corresponding tilemap tile as true
+	 * Appends the floors & walls of a group of tiles (a room, the corridors or the whole tile map).
+	 * The group is split into blocks of ProjectionBlockSize rows (and columns for merged walls) that are projected into their own arrays and concatenated in order,
+	 * so the output is the same whether it runs in parallel or not
+	 * @param Mask - the tiles of the group
+	 * @param FirstRow - the tile map row of the first mask row
+	 * @param FirstColumn - the tile map column of the first mask column
+	 * @param TileSize - the size of each tile
+	 * @param bParallel - false when the caller already runs in parallel (ie per room)
+	 * @param OutFloors - the array to append the floors to
+	 * @param OutWalls - the array to append the walls to
+	 */
+	void ProjectTileGroup(const FTileBitGrid& Mask, int32 FirstRow, int32 FirstColumn, float TileSize, bool bParallel, TArray<FFloorSpawnPoint>& OutFloors, TArray<FWallSpawnPoint>& OutWalls) const;
+
+	/**
+	 * Marks the corresponding tilemap tile as true and recounts its row
 	 */
 	void OccupyTile(const Tile& InTile);
 
+	/**
+	 * Occupies the tiles of a room and assigns them the room routing cost & label
+	 * @param RoomIndex - the index the room is stored at in GeneratedRooms
+	 */
+	void OccupyRoomTiles(const FRoomRect& Room, int32 RoomIndex);
+
+	/**
+	 * Occupies a corridor tile. Tiles that were empty get the corridor routing cost
+	 */
+	void OccupyCorridorTile(int32 Row, int32 Column);
+
+	/**
+	 * Occupies the corridor tiles [FirstColumn, LastColumn] of a row. Does nothing if the span is empty
+	 */
+	void OccupyCorridorRowSpan(int32 Row, int32 FirstColumn, int32 LastColumn);
+
+	/**
+	 * Occupies the corridor tiles [FirstRow, LastRow] of a column. Does nothing if the span is empty
+	 */
+	void OccupyCorridorColumnSpan(int32 Column, int32 FirstRow, int32 LastRow);
+
 	/**
 	 * Starts from a location and expands tiles to occupy the same space along up & right directions
 	 * @param StartTile - the starting tile of the expansion
 	 * @param ExpansionCount - the size of tiles to occupy above and right (ie a value of 3 will try to take up 9 tiles in total)
-	 * @param RoomTiles - tiles that correspond to the specific expansion
-	 * @return true, if all RoomTiles are valid, false otherwise
+	 * @param Room - the room that corresponds to the specific expansion. Only assigned when the expansion is valid
+	 * @return true, if all the room tiles are valid, false otherwise
 	 */
-	bool CreateUpperRightRoomExpansion(const Tile& StartTile, int32 ExpansionCount, TArray<Tile>& RoomTiles) const;
+	bool CreateUpperRightRoomExpansion(const Tile& StartTile, int32 ExpansionCount, FRoomRect& Room) const;
 
 	/* See CreateUpperRightRoomExpansion */
-	bool CreateLowerRightRoomExpansion(const Tile& StartTile, int32 ExpansionCount, TArray<Tile>& RoomTiles) const;
+	bool CreateLowerRightRoomExpansion(const Tile& StartTile, int32 ExpansionCount, FRoomRect& Room) const;
 
 	/* See CreateUpperRightRoomExpansion */
-	bool CreateUpperLeftRoomExpansion(const Tile& StartTile, int32 ExpansionCount, TArray<Tile>& RoomTiles) const;
+	bool CreateUpperLeftRoomExpansion(const Tile& StartTile, int32 ExpansionCount, FRoomRect& Room) const;
 
 	/* See CreateUpperRightRoomExpansion */
-	bool CreateLowerLeftRoomExpansion(const Tile& StartTile, int32 ExpansionCount, TArray<Tile>& RoomTiles) const;
+	bool CreateLowerLeftRoomExpansion(const Tile& StartTile, int32 ExpansionCount, FRoomRect& Room) const;
 
 	/**
 	 * Handy way to store a connection between tiles
@@ -248,48 +812,135 @@ private:
 	};
 
 	/**
-	 * Handy way of storing separate room tiles in a collection
+	 * A collection of GeneratedRooms
 	 */
-	struct FRoomTileCollection
-	{
-		TArray<Tile> OccupiedTiles;
+	FRoomRecords GeneratedRooms;
 
-		FRoomTileCollection()
-		{
-			OccupiedTiles.Empty();
-		}
-		FRoomTileCollection(TArray<Tile> RoomTiles)
-		{
-			OccupiedTiles = RoomTiles;
-		}
-	};
+	/**
+	 * Tiles on the edge of the tile map that open towards a neighbor tile map
+	 */
+	TArray<Tile> BorderPortals;
 
 	/**
-	 * A collection of GeneratedRooms
+	 * Returns true if the side of a tile that faces out of the map opens towards a neighbor tile map
+	 */
+	inline bool IsBorderPortal(const Tile& InTile) const { return BorderPortals.Contains(InTile); }
+
+	/**
+	 * Recomputes the routing cost of every tile from the tile map & the generated rooms
 	 */
-	TArray<FRoomTileCollection> GeneratedRooms;
+	void RebuildTileCosts();
+
+	/**
+	 * Recomputes the label of every tile from the tile map & the generated rooms. Corridor tiles are left without an index
+	 */
+	void RebuildTileLabels();
+
+	/**
+	 * Assigns an index to each connected group of corridor tiles and recomputes the room & corridor structure from the labels
+	 */
+	void RebuildLayoutGraph();
 
 	/**
 	 * Stores a new generated room.
-	 * Once we have more than a single room will also call the ConnectRooms to connect newly spawned rooms
+	 * With ERoomConnectivity::Chain, once we have more than a single room will also call the ConnectRooms to connect newly spawned rooms
 	 * @param InRoom - the new room we want to store
 	 */
-	void StoreGeneratedRoom(const FRoomTileCollection& InRoom);
+	void StoreGeneratedRoom(const FRoomRect& InRoom);
 
 	/**
 	 * Finds the closest tiles between two rooms and connects them in the shortest possible distance
 	 * @param A - the first room of the connection
 	 * @param B - the second room to connect to first
 	 */
-	void ConnectRooms(const FRoomTileCollection& A, const FRoomTileCollection& B);
+	void ConnectRooms(const FRoomRect& A, const FRoomRect& B);
+
+	/**
+	 * Occupies a Manhattan-monotone corridor between two tiles by stepping the coordinates directly.
+	 * The Start and End tiles themselves are left untouched
+	 * @param Start - the first tile of the corridor (usually a room tile)
+	 * @param End - the last tile of the corridor (usually a room tile)
+	 * @param Style - the shape of the corridor
+	 */
+	void CarveCorridor(const Tile& Start, const Tile& End, ECorridorStyle Style);
+
+	/**
+	 * Occupies the tiles of a straight corridor leg. From and To must share a row or a column
+	 * @param From - the start of the leg. Never occupied
+	 * @param To - the end of the leg
+	 * @param bIncludeTo - true if To should be occupied as well
+	 */
+	void CarveCorridorLeg(const Tile& From, const Tile& To, bool bIncludeTo);
+
+	/**
+	 * Occupies the cheapest path between two tiles based on the tile costs.
+	 * The Start and End tiles themselves are left untouched
+	 * @return false if the tiles can't reach each other (ie blocked by tiles with a cost of 0)
+	 */
+	bool RouteCorridor(const Tile& Start, const Tile& End);
+
+	/**
+	 * Finds the closest tiles between two rooms straight from their bounds.
+	 * Only valid for rooms that fill their bounds, which every room of the tile matrix does (see FRoomRect)
+	 * @param From - the room that contains the start of the connection
+	 * @param To - the room that contains the end of the connection
+	 * @return the connection between the closest tiles
+	 */
+	static FTileConnection FindClosestTilesOfRooms(const FRoomRect& From, const FRoomRect& To);
 
 	/**
 	 * Goes through all possible room expansions in a location to see if a room of a given size can be placed
 	 * in the tilemap
 	 * @param InTile - a tile to use as a starting location for the expansion
 	 * @param RoomSize - uniform size of the room
-	 * @param TilesToOccupy - expanded tiles of the room
+	 * @param Room - the expanded room
 	 * @return true, if the room can be placed in the tilemap, false otherwise
 	 */
-	bool CanPlaceRoomInTileMap(Tile InTile, int32 RoomSize, TArray<Tile>& TilesToOccupy) const;
+	bool CanPlaceRoomInTileMap(Tile InTile, int32 RoomSize, FRoomRect& Room) const;
+
+	/**
+	 * Free space index: the upper-left tiles of every MinRoomSize * MinRoomSize square that was free when the index was built.
+	 * Any room that fits has such a square in its upper-left corner, so a single index serves every room size.
+	 * Occupancy only grows during PlaceRooms so anchors never become valid again once they're stale;
+	 * they are cleared lazily when sampled. Only alive during PlaceRooms
+	 */
+	FTileBitGrid RoomAnchors;
+
+	/* Counts of the RoomAnchors, to sample them uniformly */
+	FTileBitCounts RoomAnchorCounts;
+
+	/**
+	 * Free anchors that are tried for a room of the preferred size before settling for the largest room that fit any of them
+	 */
+	static constexpr int32 MaxAnchorSamplesPerRoom = 32;
+
+	FRoomPlacementStats PlacementStats;
+
+	/**
+	 * Fills the free space index from the tile map
+	 */
+	void BuildRoomAnchors();
+
+	/**
+	 * Returns the size of the largest square room that fits with its upper-left tile on a location
+	 * @param MinSize - a size that is known to fit
+	 * @param MaxSize - the largest size to check
+	 */
+	int32 GetLargestRoomSizeAt(int32 Row, int32 Column, int32 MinSize, int32 MaxSize) const;
+
+	/**
+	 * Samples a room from the free space index. Tries up to MaxAnchorSamplesPerRoom free anchors for a room of RoomSize
+	 * and falls back to the largest room that fit any of them (never smaller than MinRoomSize)
+	 * @param RoomSize - the preferred uniform size of the room
+	 * @param Room - the sampled room
+	 * @return true if a room was found
+	 */
+	bool SampleRoomFromFreeSpace(int32 RoomSize, FRoomRect& Room);
+
+	/**
+	 * Tries random tiles up to MaxRandomAttemptsPerRoom times until a room fits
+	 * @param Room - the sampled room
+	 * @return true if a room was found
+	 */
+	bool SampleRoomFromRandomTiles(FRoomRect& Room);
 };